@@ -0,0 +1,200 @@
+#include "asset_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace assets {
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+static const uint8_t CACHE_MAGIC[4] = {'P', '2', 'A', 'C'};
+
+// Bump when the serialised layout of any asset changes
+static const uint32_t CACHE_VERSION = 2;
+
+static const size_t HEADER_SIZE = 4 + 4 + 4 + 8;
+
+static const uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+// ============================================================================
+// Hashing
+// ============================================================================
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// Content hash of one source, valid while its size and mtime are unchanged
+struct FileStamp {
+    uint64_t size = 0;
+    std::filesystem::file_time_type mtime;
+    uint64_t hash = 0;
+};
+
+static std::mutex stamps_mutex;
+static std::unordered_map<std::string, FileStamp> stamps;
+
+static bool hash_file(const std::string& filename, uint64_t& hash) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(filename, ec);
+    if (ec) return false;
+    auto mtime = std::filesystem::last_write_time(filename, ec);
+    if (ec) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(stamps_mutex);
+        auto it = stamps.find(filename);
+        if (it != stamps.end() && it->second.size == size && it->second.mtime == mtime) {
+            hash = it->second.hash;
+            return true;
+        }
+    }
+
+    try {
+        sqz::MappedFile file(filename);
+        hash = fnv1a(FNV_OFFSET, file.data(), file.size());
+        size = file.size();
+    } catch (...) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(stamps_mutex);
+    stamps[filename] = FileStamp{size, mtime, hash};
+    return true;
+}
+
+bool hash_files(const std::vector<std::string>& filenames, uint64_t& hash) {
+    hash = FNV_OFFSET;
+    for (const auto& filename : filenames) {
+        uint64_t file_hash = 0;
+        if (!hash_file(filename, file_hash)) return false;
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; i++) bytes[i] = static_cast<uint8_t>(file_hash >> (i * 8));
+        hash = fnv1a(hash, bytes, sizeof(bytes));
+    }
+    return true;
+}
+
+// ============================================================================
+// Cache Writer
+// ============================================================================
+
+CacheWriter::CacheWriter(uint32_t kind, uint64_t source_hash) {
+    buffer.assign(CACHE_MAGIC, CACHE_MAGIC + 4);
+    put_u32(CACHE_VERSION);
+    put_u32(kind);
+    put_u32(static_cast<uint32_t>(source_hash));
+    put_u32(static_cast<uint32_t>(source_hash >> 32));
+}
+
+void CacheWriter::put_u32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buffer.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+void CacheWriter::put_bytes(const uint8_t* data, size_t size) {
+    put_u32(static_cast<uint32_t>(size));
+    buffer.insert(buffer.end(), data, data + size);
+}
+
+bool CacheWriter::save(const std::string& filename) const {
+    // Per-process, per-thread temporary, so two writers saving the same
+    // entry never write into one file
+#ifdef _WIN32
+    long pid = _getpid();
+#else
+    long pid = static_cast<long>(getpid());
+#endif
+    size_t thread_tag = std::hash<std::thread::id>()(std::this_thread::get_id());
+    std::string temp = filename + "." + std::to_string(pid) + "." + std::to_string(thread_tag) + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        if (!file) {
+            file.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    bool moved = MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool moved = std::rename(temp.c_str(), filename.c_str()) == 0;
+#endif
+    if (!moved) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Cache Reader
+// ============================================================================
+
+CacheReader::CacheReader(const std::string& filename, uint32_t kind, uint64_t source_hash) {
+    try {
+        file.reset(new sqz::MappedFile(filename));
+    } catch (...) {
+        return;
+    }
+
+    cur = file->data();
+    end = cur + file->size();
+    if (file->size() < HEADER_SIZE || memcmp(cur, CACHE_MAGIC, 4) != 0) return;
+    cur += 4;
+
+    ok = true;
+    uint32_t version = get_u32();
+    uint32_t entry_kind = get_u32();
+    uint64_t hash = get_u32();
+    hash |= static_cast<uint64_t>(get_u32()) << 32;
+    ok = version == CACHE_VERSION && entry_kind == kind && hash == source_hash;
+}
+
+bool CacheReader::take(size_t size) {
+    if (!ok || static_cast<size_t>(end - cur) < size) {
+        ok = false;
+        return false;
+    }
+    return true;
+}
+
+uint32_t CacheReader::get_u32() {
+    if (!take(4)) return 0;
+    uint32_t value = cur[0] | (cur[1] << 8) | (cur[2] << 16) | (static_cast<uint32_t>(cur[3]) << 24);
+    cur += 4;
+    return value;
+}
+
+ByteSpan CacheReader::get_bytes() {
+    size_t size = get_u32();
+    if (!take(size)) return ByteSpan();
+    ByteSpan span{cur, size};
+    cur += size;
+    return span;
+}
+
+} // namespace assets
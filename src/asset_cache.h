@@ -0,0 +1,73 @@
+#pragma once
+
+#include "sqz_unpacker.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace assets {
+
+// Each cache entry is one file: a fixed header (magic, layout version, kind
+// tag, source hash) followed by the serialised asset. An entry is only used
+// when its hash matches the current source files, so editing one SQZ file
+// invalidates exactly the entries built from it.
+
+// FNV-1a over the contents of every file in order. Each file is hashed once
+// and the result reused while its size and modification time are unchanged.
+// Returns false if any source cannot be read.
+bool hash_files(const std::vector<std::string>& filenames, uint64_t& hash);
+
+// Serialises an entry in memory, then writes it out atomically
+class CacheWriter {
+public:
+    CacheWriter(uint32_t kind, uint64_t source_hash);
+
+    void put_u32(uint32_t value);
+    void put_bytes(const uint8_t* data, size_t size);
+    void put_bytes(const std::vector<uint8_t>& data) { put_bytes(data.data(), data.size()); }
+
+    // Write to a temporary file and move it over filename
+    bool save(const std::string& filename) const;
+
+private:
+    std::vector<uint8_t> buffer;
+};
+
+// Bytes borrowed from a cache mapping; only valid while the reader lives
+struct ByteSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+};
+
+// Reads an entry from a memory-mapped cache file. valid() is false when the
+// file is missing, has a different kind or hash, or was truncated.
+class CacheReader {
+public:
+    CacheReader(const std::string& filename, uint32_t kind, uint64_t source_hash);
+
+    bool valid() const { return ok; }
+
+    uint32_t get_u32();
+
+    // Next block written by put_bytes, pointing into the mapping (empty on
+    // failure)
+    ByteSpan get_bytes();
+
+    // Reject the entry after a semantic check failed
+    void invalidate() { ok = false; }
+
+private:
+    std::unique_ptr<sqz::MappedFile> file;
+    const uint8_t* cur = nullptr;
+    const uint8_t* end = nullptr;
+    bool ok = false;
+
+    bool take(size_t size);
+};
+
+} // namespace assets
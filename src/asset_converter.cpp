@@ -1,5 +1,9 @@
 #include "asset_converter.h"
 #include "sqz_unpacker.h"
+#include "asset_cache.h"
+#include "asset_registry.h"
+#include "pixel_kernels.h"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
@@ -18,6 +22,7 @@ static const int LEVEL_TILES_PER_ROW = 256;
 static const int NUM_UNION_TILES = 544;
 static const int NUM_FRONT_TILES = 163;
 static const int NUM_SPRITES = 460;
+static const int TILESET_COLUMNS = 32;  // Tiles per row in exported tileset images
 
 // Font constants
 static const int FONT_CREDITS_W = 8;
@@ -43,15 +48,172 @@ static const char* TRACK_NAMES[] = {
     "KOOL", "MINES", "MONSTER", "MYSTERY", "PRES", "PRESENTA"
 };
 
-static std::string g_sqz_path = "sqz";
-static std::string g_res_path = "res";
-static std::vector<Palette> g_level_palettes;
-static Tileset g_union_tiles;
-static Tileset g_front_tiles;
-static Spriteset g_sprites;
-static std::vector<std::vector<uint8_t>> g_font_credits;
-static bool g_initialized = false;
-static bool g_fonts_loaded = false;
+// ============================================================================
+// Decoded Asset Cache
+// ============================================================================
+
+// Entry kind tags, checked on load so an entry is never read as another type
+enum CacheKind : uint32_t {
+    CACHE_TILESET = 1,
+    CACHE_IMAGE,
+    CACHE_LEVEL,
+    CACHE_SPRITES,
+    CACHE_RAW
+};
+
+static void store(CacheWriter& out, const std::vector<uint8_t>& data) {
+    out.put_bytes(data);
+}
+
+static void load(CacheReader& in, std::vector<uint8_t>& data) {
+    ByteSpan bytes = in.get_bytes();
+    data.assign(bytes.begin(), bytes.end());
+}
+
+static void store(CacheWriter& out, const std::vector<std::vector<uint8_t>>& tiles) {
+    out.put_u32(static_cast<uint32_t>(tiles.size()));
+    for (const auto& tile : tiles) out.put_bytes(tile);
+}
+
+static void load(CacheReader& in, std::vector<std::vector<uint8_t>>& tiles) {
+    uint32_t count = in.get_u32();
+    tiles.clear();
+    for (uint32_t i = 0; i < count && in.valid(); i++) {
+        ByteSpan tile = in.get_bytes();
+        tiles.emplace_back(tile.begin(), tile.end());
+    }
+}
+
+static void store(CacheWriter& out, const Tileset& tileset) {
+    out.put_u32(tileset.tile_width);
+    out.put_u32(tileset.tile_height);
+    out.put_u32(tileset.num_tiles);
+    out.put_bytes(tileset.atlas.data(), tileset.atlas.size());
+}
+
+static void load(CacheReader& in, Tileset& tileset) {
+    tileset.tile_width = static_cast<int>(in.get_u32());
+    tileset.tile_height = static_cast<int>(in.get_u32());
+    tileset.num_tiles = static_cast<int>(in.get_u32());
+    ByteSpan atlas = in.get_bytes();
+    tileset.atlas.assign(atlas.begin(), atlas.end());
+    if (atlas.size != tileset.num_tiles * tileset.tile_stride()) {
+        in.invalidate();
+    }
+}
+
+static void store(CacheWriter& out, const Image& image) {
+    out.put_u32(image.width);
+    out.put_u32(image.height);
+    out.put_bytes(image.pixels);
+    out.put_bytes(image.palette.colors.data(), image.palette.colors.size());
+}
+
+static void load(CacheReader& in, Image& image) {
+    image.width = static_cast<int>(in.get_u32());
+    image.height = static_cast<int>(in.get_u32());
+    load(in, image.pixels);
+    ByteSpan colors = in.get_bytes();
+    if (image.pixels.size() != static_cast<size_t>(image.width) * image.height ||
+        colors.size != image.palette.colors.size()) {
+        in.invalidate();
+        return;
+    }
+    std::copy(colors.begin(), colors.end(), image.palette.colors.begin());
+}
+
+static void store(CacheWriter& out, const LevelData& level) {
+    out.put_u32(level.tilemap.width);
+    out.put_u32(level.tilemap.height);
+    out.put_bytes(level.tilemap.map);
+    out.put_bytes(reinterpret_cast<const uint8_t*>(level.tilemap.lut.data()),
+                  level.tilemap.lut.size() * sizeof(uint16_t));
+    store(out, level.local_tiles);
+    out.put_bytes(level.descriptors);
+}
+
+static void load(CacheReader& in, LevelData& level) {
+    level.tilemap.width = static_cast<int>(in.get_u32());
+    level.tilemap.height = static_cast<int>(in.get_u32());
+    load(in, level.tilemap.map);
+    ByteSpan lut = in.get_bytes();
+    if (level.tilemap.map.size() != static_cast<size_t>(level.tilemap.width) * level.tilemap.height ||
+        lut.size != 256 * sizeof(uint16_t)) {
+        in.invalidate();
+        return;
+    }
+    level.tilemap.lut.resize(256);
+    memcpy(level.tilemap.lut.data(), lut.data, lut.size);
+    load(in, level.local_tiles);
+    load(in, level.descriptors);
+}
+
+static void store(CacheWriter& out, const Spriteset& sprites) {
+    out.put_u32(static_cast<uint32_t>(sprites.entries.size()));
+    for (const auto& entry : sprites.entries) {
+        out.put_u32(entry.x);
+        out.put_u32(entry.y);
+        out.put_u32(entry.w);
+        out.put_u32(entry.h);
+    }
+    store(out, sprites.sprites);
+}
+
+static void load(CacheReader& in, Spriteset& sprites) {
+    uint32_t count = in.get_u32();
+    sprites.entries.clear();
+    for (uint32_t i = 0; i < count && in.valid(); i++) {
+        SpriteEntry entry;
+        entry.x = static_cast<int>(in.get_u32());
+        entry.y = static_cast<int>(in.get_u32());
+        entry.w = static_cast<int>(in.get_u32());
+        entry.h = static_cast<int>(in.get_u32());
+        sprites.entries.push_back(entry);
+    }
+    load(in, sprites.sprites);
+}
+
+// Return the cached copy of an asset when its entry in cache_path matches
+// the current source files, otherwise build it and refresh the entry. An
+// empty cache_path disables the cache.
+template <typename T, typename Build>
+static T load_cached(const std::string& cache_path, const std::string& entry, CacheKind kind,
+                     const std::vector<std::string>& sources, Build build) {
+    uint64_t hash = 0;
+    if (cache_path.empty() || !hash_files(sources, hash)) {
+        return build();
+    }
+
+    std::string filename = cache_path + "/" + entry + ".bin";
+    CacheReader reader(filename, kind, hash);
+    if (reader.valid()) {
+        T value;
+        load(reader, value);
+        if (reader.valid()) return value;
+    }
+
+    T value = build();
+    CacheWriter writer(kind, hash);
+    store(writer, value);
+    writer.save(filename);
+    return value;
+}
+
+// Approximate heap footprint, charged against the in-memory LRU budgets
+template <typename T>
+static size_t memory_size(const T& value);
+
+template <>
+size_t memory_size<Image>(const Image& image) {
+    return sizeof(Image) + image.pixels.capacity();
+}
+
+template <>
+size_t memory_size<LevelData>(const LevelData& level) {
+    return sizeof(LevelData) + level.tilemap.map.capacity() +
+           level.tilemap.lut.capacity() * sizeof(uint16_t) +
+           level.local_tiles.atlas.capacity() + level.descriptors.capacity();
+}
 
 // ============================================================================
 // Utility Functions
@@ -62,44 +224,13 @@ static uint8_t vga_to_rgb(uint8_t six_bit) {
     return (six_bit << 2) | (six_bit >> 4);
 }
 
-static std::vector<uint8_t> convert_planar_to_linear(const std::vector<uint8_t>& data) {
-    if (data.size() % 4 != 0) {
+// Convert planar 4bpp data straight to 8bpp indices; dst receives size * 2 bytes
+static void convert_planar_to_8bpp(const uint8_t* src, size_t size, uint8_t* dst) {
+    if (size % 4 != 0) {
         throw std::runtime_error("Data size must be multiple of 4");
     }
     
-    std::vector<uint8_t> result(data.size());
-    size_t plane_length = data.size() / 4;
-    
-    for (size_t i = 0; i < plane_length; i++) {
-        uint8_t b0 = data[plane_length * 0 + i];
-        uint8_t b1 = data[plane_length * 1 + i];
-        uint8_t b2 = data[plane_length * 2 + i];
-        uint8_t b3 = data[plane_length * 3 + i];
-        
-        for (int j = 0; j < 4; j++) {
-            int hi = ((b3 & 0x80) >> 0) | ((b2 & 0x80) >> 1) | 
-                     ((b1 & 0x80) >> 2) | ((b0 & 0x80) >> 3);
-            int lo = ((b3 & 0x40) >> 3) | ((b2 & 0x40) >> 4) | 
-                     ((b1 & 0x40) >> 5) | ((b0 & 0x40) >> 6);
-            
-            result[i * 4 + j] = static_cast<uint8_t>(hi | lo);
-            
-            b0 <<= 2; b1 <<= 2; b2 <<= 2; b3 <<= 2;
-        }
-    }
-    
-    return result;
-}
-
-static std::vector<uint8_t> convert_4bpp_to_8bpp(const std::vector<uint8_t>& packed) {
-    std::vector<uint8_t> result(packed.size() * 2);
-    
-    for (size_t i = 0; i < packed.size(); i++) {
-        result[i * 2] = (packed[i] >> 4) & 0x0F;
-        result[i * 2 + 1] = packed[i] & 0x0F;
-    }
-    
-    return result;
+    kernels::planar_to_indexed(src, size, dst);
 }
 
 static Palette load_vga_palette(const uint8_t* data, int num_colors) {
@@ -129,75 +260,39 @@ static Palette load_palette_file(const std::string& filename) {
     return load_vga_palette(data.data(), static_cast<int>(data.size() / 3));
 }
 
-static Tileset read_tiles(const std::vector<uint8_t>& data, int num_tiles, int tile_w, int tile_h) {
+// Read up to num_tiles planar tiles into an atlas; stops early if data runs out
+static Tileset read_tiles(const uint8_t* data, size_t size, int num_tiles, int tile_w, int tile_h) {
     Tileset tileset;
     tileset.tile_width = tile_w;
     tileset.tile_height = tile_h;
-    tileset.num_tiles = num_tiles;
     
-    int bytes_per_tile_planar = tile_w * tile_h / 2;
+    size_t bytes_per_tile_planar = tile_w * tile_h / 2;
+    tileset.num_tiles = static_cast<int>(std::min<size_t>(num_tiles, size / bytes_per_tile_planar));
+    tileset.atlas.resize(tileset.num_tiles * tileset.tile_stride());
     
-    for (int i = 0; i < num_tiles; i++) {
-        int offset = i * bytes_per_tile_planar;
-        if (offset + bytes_per_tile_planar > static_cast<int>(data.size())) break;
-        
-        std::vector<uint8_t> tile_data(data.begin() + offset, 
-                                        data.begin() + offset + bytes_per_tile_planar);
-        
-        auto linear = convert_planar_to_linear(tile_data);
-        auto pixels = convert_4bpp_to_8bpp(linear);
-        
-        tileset.tiles.push_back(pixels);
+    // Each tile is planar on its own, so convert tile by tile
+    for (int i = 0; i < tileset.num_tiles; i++) {
+        convert_planar_to_8bpp(data + i * bytes_per_tile_planar, bytes_per_tile_planar,
+                               tileset.tile(i));
     }
     
     return tileset;
 }
 
-static std::vector<std::vector<uint8_t>> read_tiles_from_stream(
-    const std::vector<uint8_t>& data, size_t& offset, int num_tiles, int tile_w, int tile_h) {
-    
-    std::vector<std::vector<uint8_t>> tiles;
-    int bytes_per_tile_planar = tile_w * tile_h / 2;
-    
-    for (int i = 0; i < num_tiles; i++) {
-        if (offset + bytes_per_tile_planar > data.size()) break;
-        
-        std::vector<uint8_t> tile_data(data.begin() + offset, 
-                                        data.begin() + offset + bytes_per_tile_planar);
-        offset += bytes_per_tile_planar;
-        
-        auto linear = convert_planar_to_linear(tile_data);
-        auto pixels = convert_4bpp_to_8bpp(linear);
-        
-        tiles.push_back(pixels);
-    }
-    
-    return tiles;
-}
-
-static void load_fonts() {
-    if (g_fonts_loaded) return;
-    
-    try {
-        std::string filename = g_sqz_path + "/ALLFONTS.SQZ";
-        auto data = sqz::unpack(filename);
-        
-        size_t offset = 0;
-        g_font_credits = read_tiles_from_stream(data, offset, NUM_FONT_CREDITS_CHARS, 
-                                                 FONT_CREDITS_W, FONT_CREDITS_H);
-        
-        g_fonts_loaded = true;
-    } catch (...) {}
+static Tileset read_tiles_from_stream(const std::vector<uint8_t>& data, size_t& offset,
+                                      int num_tiles, int tile_w, int tile_h) {
+    size_t available = offset < data.size() ? data.size() - offset : 0;
+    Tileset tileset = read_tiles(data.data() + offset, available, num_tiles, tile_w, tile_h);
+    offset += tileset.num_tiles * tileset.tile_stride() / 2;
+    return tileset;
 }
 
 static void draw_font_char(std::vector<uint8_t>& image, int img_width, 
-                           int x, int y, const std::vector<uint8_t>& char_pixels,
+                           int x, int y, const uint8_t* char_pixels,
                            int char_w, int char_h) {
     for (int py = 0; py < char_h; py++) {
         for (int px = 0; px < char_w; px++) {
             int src_idx = py * char_w + px;
-            if (src_idx >= static_cast<int>(char_pixels.size())) continue;
-            
             uint8_t pixel = char_pixels[src_idx];
             if (pixel == 0) continue;
             
@@ -214,18 +309,16 @@ static void draw_font_char(std::vector<uint8_t>& image, int img_width,
     }
 }
 
-static void draw_credits_line(std::vector<uint8_t>& image, int x, int y, const std::string& text) {
-    load_fonts();
-    if (g_font_credits.empty()) return;
-    
+static void draw_credits_line(std::vector<uint8_t>& image, const Tileset& fonts,
+                              int x, int y, const std::string& text) {
     int col = 0;
     for (char c : text) {
         const char* pos = strchr(FONT_CREDITS_CHARS, c);
         if (pos) {
             int idx = static_cast<int>(pos - FONT_CREDITS_CHARS);
-            if (idx >= 0 && idx < static_cast<int>(g_font_credits.size())) {
+            if (idx >= 0 && idx < fonts.num_tiles) {
                 int dst_x = x + col * FONT_CREDITS_W;
-                draw_font_char(image, 320, dst_x, y, g_font_credits[idx], 
+                draw_font_char(image, 320, dst_x, y, fonts.tile(idx), 
                                FONT_CREDITS_W, FONT_CREDITS_H);
             }
         }
@@ -234,12 +327,12 @@ static void draw_credits_line(std::vector<uint8_t>& image, int x, int y, const s
 }
 
 // Copy pixels from source to destination
-static void copy_pixels(const std::vector<uint8_t>& src, int src_w, int src_h,
+static void copy_pixels(const uint8_t* src, size_t src_size, int src_w, int src_h,
                         std::vector<uint8_t>& dst, int dst_w, int dst_x, int dst_y) {
     for (int y = 0; y < src_h; y++) {
         for (int x = 0; x < src_w; x++) {
             int src_idx = y * src_w + x;
-            if (src_idx >= static_cast<int>(src.size())) continue;
+            if (src_idx >= static_cast<int>(src_size)) continue;
             
             int dx = dst_x + x;
             int dy = dst_y + y;
@@ -261,21 +354,43 @@ static void create_directory(const std::string& path) {
 }
 
 // ============================================================================
-// Public Functions
+// Context
 // ============================================================================
 
-void set_sqz_path(const std::string& path) {
-    g_sqz_path = path;
+Context::Context(const std::string& sqz_dir, const std::string& res_dir,
+                 const std::string& cache_dir)
+    : sqz_path(sqz_dir), res_path(res_dir), registry(new AssetRegistry()) {
+    set_cache_path(cache_dir);
 }
 
-void set_res_path(const std::string& path) {
-    g_res_path = path;
+Context::~Context() = default;
+
+void Context::set_sqz_path(const std::string& path) {
+    sqz_path = path;
+    reset_registry();
 }
 
-void load_level_palettes(const std::string& res_path) {
-    g_res_path = res_path;
-    
-    std::string filename = res_path + "/levels.pals";
+void Context::set_res_path(const std::string& path) {
+    res_path = path;
+    reset_registry();
+}
+
+// Start over with empty caches, keeping their budgets
+void Context::reset_registry() {
+    std::unique_ptr<AssetRegistry> fresh(new AssetRegistry());
+    fresh->levels.set_budget(registry->levels.stats().budget);
+    fresh->backgrounds.set_budget(registry->backgrounds.stats().budget);
+    registry = std::move(fresh);
+}
+
+void Context::set_cache_path(const std::string& path) {
+    cache_path = path;
+    if (!cache_path.empty()) {
+        create_directory(cache_path);
+    }
+}
+
+static std::vector<Palette> read_level_palettes(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
     if (!file) {
         throw std::runtime_error("Cannot open: " + filename);
@@ -284,51 +399,75 @@ void load_level_palettes(const std::string& res_path) {
     const int num_palettes = 13;
     const int bytes_per_palette = 3 * 16;
     
-    g_level_palettes.resize(num_palettes);
+    std::vector<Palette> palettes(num_palettes);
     
     for (int i = 0; i < num_palettes; i++) {
         uint8_t pal_data[bytes_per_palette];
         file.read(reinterpret_cast<char*>(pal_data), bytes_per_palette);
-        g_level_palettes[i] = load_vga_palette(pal_data, 16);
+        palettes[i] = load_vga_palette(pal_data, 16);
     }
     
-    g_initialized = true;
+    return palettes;
 }
 
-Palette get_level_palette(int level_idx) {
-    if (!g_initialized) {
-        load_level_palettes(g_res_path);
-    }
+std::shared_ptr<const std::vector<Palette>> Context::level_palettes() {
+    return registry->level_palettes.get([&]() {
+        return read_level_palettes(res_path + "/levels.pals");
+    });
+}
+
+void Context::set_level_cache_budget(size_t bytes) {
+    registry->levels.set_budget(bytes);
+}
+
+void Context::set_background_cache_budget(size_t bytes) {
+    registry->backgrounds.set_budget(bytes);
+}
+
+util::LruStats Context::level_cache_stats() const {
+    return registry->levels.stats();
+}
+
+util::LruStats Context::background_cache_stats() const {
+    return registry->backgrounds.stats();
+}
+
+void Context::load_level_palettes() {
+    level_palettes();
+}
+
+Palette Context::get_level_palette(int level_idx) {
+    auto palettes = level_palettes();
     
     int pal_idx = LEVEL_PALS[level_idx % NUM_LEVELS];
-    if (pal_idx >= 0 && pal_idx < static_cast<int>(g_level_palettes.size())) {
-        return g_level_palettes[pal_idx];
+    if (pal_idx >= 0 && pal_idx < static_cast<int>(palettes->size())) {
+        return (*palettes)[pal_idx];
     }
-    return g_level_palettes[0];
+    return (*palettes)[0];
 }
 
-Tileset get_union_tiles() {
-    if (g_union_tiles.num_tiles == 0) {
-        std::string filename = g_sqz_path + "/UNION.SQZ";
-        auto data = sqz::unpack(filename);
-        g_union_tiles = read_tiles(data, NUM_UNION_TILES, TILE_SIDE, TILE_SIDE);
-    }
-    return g_union_tiles;
+std::shared_ptr<const Tileset> Context::get_union_tiles() {
+    return registry->union_tiles.get([&]() {
+        std::string filename = sqz_path + "/UNION.SQZ";
+        return load_cached<Tileset>(cache_path, "UNION", CACHE_TILESET, {filename}, [&]() {
+            auto data = sqz::unpack(filename);
+            return read_tiles(data.data(), data.size(), NUM_UNION_TILES, TILE_SIDE, TILE_SIDE);
+        });
+    });
 }
 
-Tileset get_front_tiles() {
-    if (g_front_tiles.num_tiles == 0) {
-        std::string filename = g_sqz_path + "/FRONT.SQZ";
-        auto data = sqz::unpack(filename);
-        g_front_tiles = read_tiles(data, NUM_FRONT_TILES, TILE_SIDE, TILE_SIDE);
-    }
-    return g_front_tiles;
+std::shared_ptr<const Tileset> Context::get_front_tiles() {
+    return registry->front_tiles.get([&]() {
+        std::string filename = sqz_path + "/FRONT.SQZ";
+        return load_cached<Tileset>(cache_path, "FRONT", CACHE_TILESET, {filename}, [&]() {
+            auto data = sqz::unpack(filename);
+            return read_tiles(data.data(), data.size(), NUM_FRONT_TILES, TILE_SIDE, TILE_SIDE);
+        });
+    });
 }
 
-Image get_level_background(int level_idx) {
-    char suffix = BACK_SUFFIXES[level_idx % NUM_LEVELS];
-    std::string filename = g_sqz_path + "/BACK" + suffix + ".SQZ";
-    
+// Planar 4bpp 320x200 screen; the palette is supplied by the caller
+static Image decode_index4(const std::string& filename) {
     auto data = sqz::unpack(filename);
     
     const int width = 320;
@@ -339,26 +478,30 @@ Image get_level_background(int level_idx) {
         data.resize(expected_size, 0);
     }
     
-    auto linear = convert_planar_to_linear(std::vector<uint8_t>(data.begin(), data.begin() + expected_size));
-    auto pixels = convert_4bpp_to_8bpp(linear);
-    
     Image img;
     img.width = width;
     img.height = height;
-    img.pixels = pixels;
-    img.palette = get_level_palette(level_idx);
+    img.pixels.resize(width * height);
+    convert_planar_to_8bpp(data.data(), expected_size, img.pixels.data());
     
     return img;
 }
 
-LevelData get_level_data(int level_idx) {
-    char suffix = LEVEL_SUFFIXES[level_idx % NUM_LEVELS];
-    std::string filename = g_sqz_path + "/LEVEL" + suffix + ".SQZ";
-    
+std::shared_ptr<const Image> Context::get_level_background(int level_idx) {
+    std::string name = std::string("BACK") + BACK_SUFFIXES[level_idx % NUM_LEVELS];
+    
+    return registry->backgrounds.get(name, [&]() {
+        std::string filename = sqz_path + "/" + name + ".SQZ";
+        return load_cached<Image>(cache_path, name, CACHE_IMAGE, {filename}, [&]() {
+            return decode_index4(filename);
+        });
+    }, memory_size<Image>);
+}
+
+static LevelData decode_level(const std::string& filename, int num_rows) {
     auto data = sqz::unpack(filename);
     
     LevelData level;
-    int num_rows = LEVEL_NUM_ROWS[level_idx % NUM_LEVELS];
     int tilemap_length = num_rows * LEVEL_TILES_PER_ROW;
     
     level.tilemap.width = LEVEL_TILES_PER_ROW;
@@ -383,22 +526,34 @@ LevelData get_level_data(int level_idx) {
     int num_local_tiles = max_local_idx + 1;
     int bytes_per_tile = TILE_SIDE * TILE_SIDE / 2;
     
-    std::vector<uint8_t> tiles_data(data.begin() + tiles_offset, 
-                                     data.begin() + tiles_offset + num_local_tiles * bytes_per_tile);
-    level.local_tiles = read_tiles(tiles_data, num_local_tiles, TILE_SIDE, TILE_SIDE);
+    size_t tiles_size = std::min<size_t>(num_local_tiles * bytes_per_tile,
+                                         data.size() > tiles_offset ? data.size() - tiles_offset : 0);
+    level.local_tiles = read_tiles(data.data() + tiles_offset, tiles_size, num_local_tiles,
+                                   TILE_SIDE, TILE_SIDE);
     
     size_t desc_offset = tiles_offset + num_local_tiles * bytes_per_tile;
     if (desc_offset + 5029 <= data.size()) {
         level.descriptors.assign(data.begin() + desc_offset, data.begin() + desc_offset + 5029);
     }
     
-    level.palette = get_level_palette(level_idx);
-    
     return level;
 }
 
-static Image get_index8_with_palette(const std::string& name) {
-    std::string filename = g_sqz_path + "/" + name + ".SQZ";
+std::shared_ptr<const LevelData> Context::get_level_data(int level_idx) {
+    level_idx %= NUM_LEVELS;
+    
+    return registry->levels.get(level_idx, [&]() {
+        std::string name = std::string("LEVEL") + LEVEL_SUFFIXES[level_idx];
+        std::string filename = sqz_path + "/" + name + ".SQZ";
+        int num_rows = LEVEL_NUM_ROWS[level_idx];
+        return load_cached<LevelData>(cache_path, name, CACHE_LEVEL, {filename}, [&]() {
+            return decode_level(filename, num_rows);
+        });
+    }, memory_size<LevelData>);
+}
+
+// 8bpp 320x200 screen preceded by its own 256-color palette
+static Image decode_index8(const std::string& filename) {
     auto data = sqz::unpack(filename);
     
     const int width = 320;
@@ -413,38 +568,48 @@ static Image get_index8_with_palette(const std::string& name) {
     return img;
 }
 
-static Image get_index4_with_palette(const std::string& name, const std::string& pal_file) {
-    std::string filename = g_sqz_path + "/" + name + ".SQZ";
-    auto data = sqz::unpack(filename);
-    
-    const int width = 320;
-    const int height = 200;
-    const int expected_size = width * height / 2;
-    
-    if (data.size() < static_cast<size_t>(expected_size)) {
-        data.resize(expected_size, 0);
-    }
-    
-    auto linear = convert_planar_to_linear(std::vector<uint8_t>(data.begin(), data.begin() + expected_size));
-    auto pixels = convert_4bpp_to_8bpp(linear);
-    
-    Image img;
-    img.width = width;
-    img.height = height;
-    img.pixels = pixels;
-    img.palette = load_palette_file(g_res_path + "/" + pal_file);
+Image Context::get_index8_with_palette(const std::string& name) {
+    std::string filename = sqz_path + "/" + name + ".SQZ";
+    return load_cached<Image>(cache_path, name, CACHE_IMAGE, {filename}, [&]() {
+        return decode_index8(filename);
+    });
+}
+
+Image Context::get_index4_with_palette(const std::string& name, const std::string& pal_file) {
+    std::string filename = sqz_path + "/" + name + ".SQZ";
+    Image img = load_cached<Image>(cache_path, name, CACHE_IMAGE, {filename}, [&]() {
+        return decode_index4(filename);
+    });
+    img.palette = load_palette_file(res_path + "/" + pal_file);
     
     return img;
 }
 
-Image get_titus_bitmap() { return get_index8_with_palette("TITUS"); }
-Image get_menu_bitmap() { return get_index8_with_palette("MENU"); }
-Image get_castle_bitmap() { return get_index8_with_palette("CASTLE"); }
-Image get_theend_bitmap() { return get_index8_with_palette("THEEND"); }
-Image get_map_bitmap() { return get_index4_with_palette("MAP", "map.pal"); }
-Image get_gameover_bitmap() { return get_index4_with_palette("GAMEOVER", "gameover.pal"); }
+Image Context::get_titus_bitmap() { return get_index8_with_palette("TITUS"); }
+Image Context::get_menu_bitmap() { return get_index8_with_palette("MENU"); }
+Image Context::get_castle_bitmap() { return get_index8_with_palette("CASTLE"); }
+Image Context::get_theend_bitmap() { return get_index8_with_palette("THEEND"); }
+Image Context::get_map_bitmap() { return get_index4_with_palette("MAP", "map.pal"); }
+Image Context::get_gameover_bitmap() { return get_index4_with_palette("GAMEOVER", "gameover.pal"); }
+
+// Credits font, or nullptr if ALLFONTS.SQZ cannot be loaded
+std::shared_ptr<const Tileset> Context::load_fonts() {
+    try {
+        return registry->font_credits.get([&]() {
+            std::string filename = sqz_path + "/ALLFONTS.SQZ";
+            return load_cached<Tileset>(cache_path, "ALLFONTS", CACHE_TILESET, {filename}, [&]() {
+                auto data = sqz::unpack(filename);
+                size_t offset = 0;
+                return read_tiles_from_stream(data, offset, NUM_FONT_CREDITS_CHARS,
+                                              FONT_CREDITS_W, FONT_CREDITS_H);
+            });
+        });
+    } catch (...) {
+        return nullptr;
+    }
+}
 
-Image get_credits_bitmap() {
+Image Context::get_credits_bitmap() {
     const int width = 320;
     const int height = 200;
     
@@ -452,25 +617,28 @@ Image get_credits_bitmap() {
     img.width = width;
     img.height = height;
     img.pixels.resize(width * height, 0);
-    img.palette = load_palette_file(g_res_path + "/credits.pal");
+    img.palette = load_palette_file(res_path + "/credits.pal");
+    
+    auto fonts = load_fonts();
+    if (!fonts) return img;
     
     int w = FONT_CREDITS_W;
     int h = FONT_CREDITS_H;
     
-    draw_credits_line(img.pixels,  1 * w,  8 +  0 * h, "CODER. DESIGNER AND ARTIST DIRECTOR.");
-    draw_credits_line(img.pixels, 14 * w, 10 +  1 * h, "ERIC ZMIRO");
-    draw_credits_line(img.pixels,  4 * w,  2 +  4 * h, ".MAIN GRAPHICS AND BACKGROUND.");
-    draw_credits_line(img.pixels, 11 * w,  4 +  5 * h, "FRANCIS FOURNIER");
-    draw_credits_line(img.pixels,  9 * w,  8 +  7 * h, ".MONSTERS AND HEROS.");
-    draw_credits_line(img.pixels, 11 * w, 10 +  8 * h, "LYES  BELAIDOUNI");
-    draw_credits_line(img.pixels, 15 * w,  6 + 12 * h, "THANKS TO");
-    draw_credits_line(img.pixels,  2 * w,  0 + 14 * h, "CRISTELLE. GIL ESPECHE AND CORINNE.");
-    draw_credits_line(img.pixels,  0 * w,  0 + 15 * h, "SEBASTIEN BECHET AND OLIVIER AKA DELTA.");
+    draw_credits_line(img.pixels, *fonts,  1 * w,  8 +  0 * h, "CODER. DESIGNER AND ARTIST DIRECTOR.");
+    draw_credits_line(img.pixels, *fonts, 14 * w, 10 +  1 * h, "ERIC ZMIRO");
+    draw_credits_line(img.pixels, *fonts,  4 * w,  2 +  4 * h, ".MAIN GRAPHICS AND BACKGROUND.");
+    draw_credits_line(img.pixels, *fonts, 11 * w,  4 +  5 * h, "FRANCIS FOURNIER");
+    draw_credits_line(img.pixels, *fonts,  9 * w,  8 +  7 * h, ".MONSTERS AND HEROS.");
+    draw_credits_line(img.pixels, *fonts, 11 * w, 10 +  8 * h, "LYES  BELAIDOUNI");
+    draw_credits_line(img.pixels, *fonts, 15 * w,  6 + 12 * h, "THANKS TO");
+    draw_credits_line(img.pixels, *fonts,  2 * w,  0 + 14 * h, "CRISTELLE. GIL ESPECHE AND CORINNE.");
+    draw_credits_line(img.pixels, *fonts,  0 * w,  0 + 15 * h, "SEBASTIEN BECHET AND OLIVIER AKA DELTA.");
     
     return img;
 }
 
-Image get_year_bitmap() {
+Image Context::get_year_bitmap() {
     const int width = 320;
     const int height = 200;
     
@@ -478,44 +646,51 @@ Image get_year_bitmap() {
     img.width = width;
     img.height = height;
     img.pixels.resize(width * height, 0);
-    img.palette = load_palette_file(g_res_path + "/credits.pal");
+    img.palette = load_palette_file(res_path + "/credits.pal");
     
+    // localtime() shares one static buffer between threads
     time_t now = time(nullptr);
-    struct tm* tm_info = localtime(&now);
-    int year = 1900 + tm_info->tm_year;
-    
-    if (year >= 1996 && year <= 2067) {
+    struct tm tm_info = {};
+#ifdef _WIN32
+    localtime_s(&tm_info, &now);
+#else
+    localtime_r(&now, &tm_info);
+#endif
+    int year = 1900 + tm_info.tm_year;
+    
+    auto fonts = load_fonts();
+    if (fonts && year >= 1996 && year <= 2067) {
         std::string year_str = std::to_string(year);
         int x = (width - static_cast<int>(year_str.length()) * FONT_CREDITS_W) / 2;
         int y = height / 2 - FONT_CREDITS_H / 2;
-        draw_credits_line(img.pixels, x, y, year_str);
+        draw_credits_line(img.pixels, *fonts, x, y, year_str);
     }
     
     return img;
 }
 
-Image get_dev_photo() {
-    std::string filename_h = g_sqz_path + "/LEVELH.SQZ";
-    std::string filename_i = g_sqz_path + "/LEVELI.SQZ";
-    
-    auto planes01 = sqz::unpack(filename_h);
-    auto planes02 = sqz::unpack(filename_i);
-    
-    std::vector<uint8_t> planes;
-    planes.insert(planes.end(), planes01.begin(), planes01.end());
-    planes.insert(planes.end(), planes02.begin(), planes02.end());
-    
-    auto linear = convert_planar_to_linear(planes);
-    auto pixels = convert_4bpp_to_8bpp(linear);
+// 640x480 photo whose planes are split across two archives
+static Image decode_dev_photo(const std::string& filename_h, const std::string& filename_i) {
+    // Unpack both halves back to back into one buffer
+    sqz::MappedFile file_h(filename_h);
+    sqz::MappedFile file_i(filename_i);
+    size_t size_h = sqz::probe(file_h.data(), file_h.size()).payload_size;
+    size_t size_i = sqz::probe(file_i.data(), file_i.size()).payload_size;
+    
+    std::vector<uint8_t> planes(size_h + size_i);
+    size_t produced = sqz::unpack_into(file_h.data(), file_h.size(), planes.data(), size_h);
+    produced += sqz::unpack_into(file_i.data(), file_i.size(), planes.data() + produced,
+                                 planes.size() - produced);
     
     const int width = 640;
     const int height = 480;
-    pixels.resize(width * height, 0);
     
     Image img;
     img.width = width;
     img.height = height;
-    img.pixels = pixels;
+    img.pixels.resize(produced * 2);
+    convert_planar_to_8bpp(planes.data(), produced, img.pixels.data());
+    img.pixels.resize(width * height, 0);
     
     for (int i = 0; i < 16; i++) {
         uint8_t c = vga_to_rgb(static_cast<uint8_t>(i * 4));
@@ -527,84 +702,110 @@ Image get_dev_photo() {
     return img;
 }
 
-Spriteset get_sprites() {
-    if (g_sprites.sprites.empty()) {
-        std::string txt_file = g_res_path + "/sprites.txt";
-        std::ifstream file(txt_file);
-        if (!file) {
-            throw std::runtime_error("Cannot open: " + txt_file);
-        }
-        
-        g_sprites.entries.resize(NUM_SPRITES);
+Image Context::get_dev_photo() {
+    std::string filename_h = sqz_path + "/LEVELH.SQZ";
+    std::string filename_i = sqz_path + "/LEVELI.SQZ";
+    
+    return load_cached<Image>(cache_path, "LEVELHI", CACHE_IMAGE, {filename_h, filename_i}, [&]() {
+        return decode_dev_photo(filename_h, filename_i);
+    });
+}
+
+static Spriteset decode_sprites(const std::string& txt_file, const std::string& sqz_file) {
+    std::ifstream file(txt_file);
+    if (!file) {
+        throw std::runtime_error("Cannot open: " + txt_file);
+    }
+    
+    Spriteset sprites;
+    sprites.entries.resize(NUM_SPRITES);
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
         
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty()) continue;
-            
-            std::istringstream iss(line);
-            int idx;
-            char eq;
-            int x, y, w, h;
-            if (iss >> idx >> eq >> x >> y >> w >> h) {
-                if (idx >= 0 && idx < NUM_SPRITES) {
-                    g_sprites.entries[idx] = {x, y, w, h};
-                }
+        std::istringstream iss(line);
+        int idx;
+        char eq;
+        int x, y, w, h;
+        if (iss >> idx >> eq >> x >> y >> w >> h) {
+            if (idx >= 0 && idx < NUM_SPRITES) {
+                sprites.entries[idx] = {x, y, w, h};
             }
         }
+    }
+    
+    auto data = sqz::unpack(sqz_file);
+    
+    size_t offset = 0;
+    sprites.sprites.reserve(NUM_SPRITES);
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        const auto& entry = sprites.entries[i];
+        size_t bytes_planar = entry.w * entry.h / 2;
         
-        std::string sqz_file = g_sqz_path + "/SPRITES.SQZ";
-        auto data = sqz::unpack(sqz_file);
+        if (offset + bytes_planar > data.size()) break;
         
-        size_t offset = 0;
-        for (int i = 0; i < NUM_SPRITES; i++) {
-            const auto& entry = g_sprites.entries[i];
-            int bytes_planar = entry.w * entry.h / 2;
-            
-            if (offset + bytes_planar > data.size()) break;
-            
-            std::vector<uint8_t> sprite_data(data.begin() + offset,
-                                              data.begin() + offset + bytes_planar);
-            
-            auto linear = convert_planar_to_linear(sprite_data);
-            auto pixels = convert_4bpp_to_8bpp(linear);
-            
-            g_sprites.sprites.push_back(pixels);
-            offset += bytes_planar;
-        }
+        sprites.sprites.emplace_back(bytes_planar * 2);
+        convert_planar_to_8bpp(data.data() + offset, bytes_planar, sprites.sprites.back().data());
+        offset += bytes_planar;
     }
     
-    return g_sprites;
+    return sprites;
+}
+
+std::shared_ptr<const Spriteset> Context::get_sprites() {
+    return registry->sprites.get([&]() {
+        std::string txt_file = res_path + "/sprites.txt";
+        std::string sqz_file = sqz_path + "/SPRITES.SQZ";
+        return load_cached<Spriteset>(cache_path, "SPRITES", CACHE_SPRITES, {txt_file, sqz_file}, [&]() {
+            return decode_sprites(txt_file, sqz_file);
+        });
+    });
 }
 
 // ============================================================================
 // Music functions
 // ============================================================================
 
-static std::vector<uint8_t> get_track_data(const std::string& name) {
-    std::string filename = g_sqz_path + "/" + name + ".TRK";
-    return sqz::unpack(filename);
+std::vector<uint8_t> Context::get_track_data(const std::string& name) {
+    std::string filename = sqz_path + "/" + name + ".TRK";
+    return load_cached<std::vector<uint8_t>>(cache_path, name + ".TRK", CACHE_RAW, {filename}, [&]() {
+        return sqz::unpack(filename);
+    });
 }
 
-std::vector<uint8_t> get_level_track(int level_idx) {
+std::vector<uint8_t> Context::get_level_track(int level_idx) {
     Track track = LEVEL_TRACKS[level_idx % NUM_LEVELS];
     return get_track_data(TRACK_NAMES[static_cast<int>(track)]);
 }
 
-std::vector<uint8_t> get_intro_track() { return get_track_data("PRESENTA"); }
-std::vector<uint8_t> get_menu_track() { return get_track_data("CARTE"); }
-std::vector<uint8_t> get_gameover_track() { return get_track_data("BOULA"); }
-std::vector<uint8_t> get_boss_track() { return get_track_data("MONSTER"); }
-std::vector<uint8_t> get_bravo_track() { return get_track_data("BRAVO"); }
-std::vector<uint8_t> get_motif_track() { return get_track_data("CODE"); }
+std::vector<uint8_t> Context::get_intro_track() { return get_track_data("PRESENTA"); }
+std::vector<uint8_t> Context::get_menu_track() { return get_track_data("CARTE"); }
+std::vector<uint8_t> Context::get_gameover_track() { return get_track_data("BOULA"); }
+std::vector<uint8_t> Context::get_boss_track() { return get_track_data("MONSTER"); }
+std::vector<uint8_t> Context::get_bravo_track() { return get_track_data("BRAVO"); }
+std::vector<uint8_t> Context::get_motif_track() { return get_track_data("CODE"); }
 
 // ============================================================================
 // Export Tools
 // ============================================================================
 
-bool write_bmp(const std::string& filename, const Image& image) {
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) return false;
-    
+const char* image_extension(ImageFormat format) {
+    return format == ImageFormat::Png ? ".png" : ".bmp";
+}
+
+// Little-endian header field; header offsets are not aligned
+static void put_le(uint8_t* dst, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        dst[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+std::vector<uint8_t> encode_bmp(const Image& image) {
+    return encode_bmp(image, image.palette);
+}
+
+std::vector<uint8_t> encode_bmp(const Image& image, const Palette& palette) {
     int row_padding = (4 - (image.width % 4)) % 4;
     int row_size = image.width + row_padding;
     int pixel_data_size = row_size * image.height;
@@ -612,72 +813,93 @@ bool write_bmp(const std::string& filename, const Image& image) {
     int header_size = 14 + 40;
     int file_size = header_size + palette_size + pixel_data_size;
     
+    std::vector<uint8_t> file(file_size, 0);
+    
     // BMP Header
-    uint8_t header[54] = {0};
+    uint8_t* header = file.data();
     header[0] = 'B'; header[1] = 'M';
-    *reinterpret_cast<uint32_t*>(&header[2]) = file_size;
-    *reinterpret_cast<uint32_t*>(&header[10]) = header_size + palette_size;
-    *reinterpret_cast<uint32_t*>(&header[14]) = 40;  // DIB header size
-    *reinterpret_cast<int32_t*>(&header[18]) = image.width;
-    *reinterpret_cast<int32_t*>(&header[22]) = -image.height;  // Top-down
-    *reinterpret_cast<uint16_t*>(&header[26]) = 1;   // Planes
-    *reinterpret_cast<uint16_t*>(&header[28]) = 8;   // Bits per pixel
-    *reinterpret_cast<uint32_t*>(&header[34]) = pixel_data_size;
-    
-    file.write(reinterpret_cast<char*>(header), 54);
+    put_le(&header[2], file_size, 4);
+    put_le(&header[10], header_size + palette_size, 4);
+    put_le(&header[14], 40, 4);  // DIB header size
+    put_le(&header[18], image.width, 4);
+    put_le(&header[22], static_cast<uint32_t>(-image.height), 4);  // Top-down
+    put_le(&header[26], 1, 2);   // Planes
+    put_le(&header[28], 8, 2);   // Bits per pixel
+    put_le(&header[34], pixel_data_size, 4);
     
     // Palette (BGRA format)
+    uint8_t* bgra = file.data() + header_size;
     for (int i = 0; i < 256; i++) {
-        uint8_t bgra[4] = {
-            image.palette.b(i),
-            image.palette.g(i),
-            image.palette.r(i),
-            0
-        };
-        file.write(reinterpret_cast<char*>(bgra), 4);
+        bgra[i * 4 + 0] = palette.b(i);
+        bgra[i * 4 + 1] = palette.g(i);
+        bgra[i * 4 + 2] = palette.r(i);
     }
     
-    // Pixel data
-    std::vector<uint8_t> row(row_size, 0);
+    // Pixel data, rows padded to 4 bytes (padding already zero)
+    uint8_t* rows = bgra + palette_size;
     for (int y = 0; y < image.height; y++) {
-        for (int x = 0; x < image.width; x++) {
-            row[x] = image.pixels[y * image.width + x];
-        }
-        file.write(reinterpret_cast<char*>(row.data()), row_size);
+        std::memcpy(rows + static_cast<size_t>(y) * row_size,
+                    image.pixels.data() + static_cast<size_t>(y) * image.width, image.width);
     }
     
-    return true;
+    return file;
 }
 
-bool write_raw(const std::string& filename, const std::vector<uint8_t>& data) {
+bool write_bmp(const std::string& filename, const Image& image) {
+    std::vector<uint8_t> file = encode_bmp(image);
+    return write_raw(filename, file);
+}
+
+static bool write_png(const std::string& filename, const Image& image, const Palette& palette, int level) {
+    if (image.width <= 0 || image.height <= 0) return false;
+    std::vector<uint8_t> file = png::encode_indexed(image.pixels.data(), image.width, image.height,
+                                                    palette.colors.data(), 256, level);
+    return write_raw(filename, file);
+}
+
+bool write_png(const std::string& filename, const Image& image, int level) {
+    return write_png(filename, image, image.palette, level);
+}
+
+bool write_image(const std::string& base_path, const Image& image, ImageFormat format, int png_level) {
+    return write_image(base_path, image, image.palette, format, png_level);
+}
+
+bool write_image(const std::string& base_path, const Image& image, const Palette& palette,
+                 ImageFormat format, int png_level) {
+    std::string filename = base_path + image_extension(format);
+    if (format == ImageFormat::Png) return write_png(filename, image, palette, png_level);
+    return write_raw(filename, encode_bmp(image, palette));
+}
+
+bool write_raw(const std::string& filename, const void* data, size_t size) {
     std::ofstream file(filename, std::ios::binary);
     if (!file) return false;
-    file.write(reinterpret_cast<const char*>(data.data()), data.size());
-    return true;
+    file.write(static_cast<const char*>(data), size);
+    return static_cast<bool>(file);
+}
+
+bool write_raw(const std::string& filename, const std::vector<uint8_t>& data) {
+    return write_raw(filename, data.data(), data.size());
 }
 
 bool write_tsx(const std::string& base_name, const std::string& out_path,
-               int tile_w, int tile_h, int image_w, int image_h) {
-    std::string filename = out_path + "/" + base_name + ".tsx";
-    std::ofstream file(filename);
-    if (!file) return false;
-    
-    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-    file << "<tileset name=\"" << base_name << "\" tilewidth=\"" << tile_w 
-         << "\" tileheight=\"" << tile_h << "\">\n";
-    file << "  <image source=\"" << base_name << ".bmp\" width=\"" << image_w 
-         << "\" height=\"" << image_h << "\"/>\n";
-    file << "</tileset>\n";
-    
-    return true;
+               int tile_w, int tile_h, int image_w, int image_h, ImageFormat format) {
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    xml << "<tileset name=\"" << base_name << "\" tilewidth=\"" << tile_w 
+        << "\" tileheight=\"" << tile_h << "\">\n";
+    xml << "  <image source=\"" << base_name << image_extension(format) << "\" width=\"" << image_w 
+        << "\" height=\"" << image_h << "\"/>\n";
+    xml << "</tileset>\n";
+    
+    std::string text = xml.str();
+    return write_raw(out_path + "/" + base_name + ".tsx", text.data(), text.size());
 }
 
-bool generate_tileset(const Tileset& tiles, const Palette& palette,
-                      int tiles_per_row, const std::string& out_path,
-                      const std::string& base_name) {
-    if (tiles.tiles.empty()) return false;
-    
-    int num_tiles = static_cast<int>(tiles.tiles.size());
+// Lay tiles out left to right, top to bottom, tiles_per_row to a row
+static Image build_tileset_image(const Tileset& tiles, const Palette& palette, int tiles_per_row) {
+    int num_tiles = tiles.num_tiles;
     int tiles_per_col = divide_round_up(num_tiles, tiles_per_row);
     
     int out_width = tiles.tile_width * tiles_per_row;
@@ -694,16 +916,64 @@ bool generate_tileset(const Tileset& tiles, const Palette& palette,
             int tile_idx = row * tiles_per_row + col;
             if (tile_idx >= num_tiles) break;
             
-            copy_pixels(tiles.tiles[tile_idx], tiles.tile_width, tiles.tile_height,
+            copy_pixels(tiles.tile(tile_idx), tiles.tile_stride(), tiles.tile_width, tiles.tile_height,
                         img.pixels, out_width, col * tiles.tile_width, row * tiles.tile_height);
         }
     }
     
-    std::string bmp_file = out_path + "/" + base_name + ".bmp";
-    write_bmp(bmp_file, img);
-    write_tsx(base_name, out_path, tiles.tile_width, tiles.tile_height, out_width, out_height);
+    return img;
+}
+
+bool generate_tileset(const Tileset& tiles, const Palette& palette,
+                      int tiles_per_row, const std::string& out_path,
+                      const std::string& base_name, ImageFormat format, int png_level) {
+    if (tiles.num_tiles == 0) return false;
+    
+    Image img = build_tileset_image(tiles, palette, tiles_per_row);
+    
+    return write_image(out_path + "/" + base_name, img, format, png_level) &&
+           write_tsx(base_name, out_path, tiles.tile_width, tiles.tile_height, img.width, img.height, format);
+}
+
+bool write_tmx(const std::string& base_name, const std::string& out_path,
+               const LevelData& level, const Tileset& union_tiles) {
+    std::ostringstream file;
+    const Tilemap& map = level.tilemap;
+    int union_first_gid = 1 + level.local_tiles.num_tiles;
+    
+    file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    file << "<map version=\"1.0\" orientation=\"orthogonal\" renderorder=\"right-down\" width=\""
+         << map.width << "\" height=\"" << map.height << "\" tilewidth=\"" << TILE_SIDE
+         << "\" tileheight=\"" << TILE_SIDE << "\">\n";
+    file << "  <tileset firstgid=\"1\" source=\"" << base_name << "_TILES.tsx\"/>\n";
+    file << "  <tileset firstgid=\"" << union_first_gid << "\" source=\"UNION.tsx\"/>\n";
+    file << "  <layer name=\"tiles\" width=\"" << map.width << "\" height=\"" << map.height << "\">\n";
+    file << "    <data encoding=\"csv\">\n";
+    
+    // Same lookup as the renderer: LUT values below 256 are local tiles,
+    // 256 is the empty union tile, the rest are union tiles
+    for (int y = 0; y < map.height; y++) {
+        for (int x = 0; x < map.width; x++) {
+            uint16_t lut_value = map.lut[map.map[y * map.width + x]];
+            int gid = 0;
+            if (lut_value < 256) {
+                if (lut_value < level.local_tiles.num_tiles) gid = 1 + lut_value;
+            } else if (lut_value > 256 && lut_value < 256 + union_tiles.num_tiles) {
+                gid = union_first_gid + (lut_value - 256);
+            }
+            
+            file << gid;
+            if (x + 1 < map.width || y + 1 < map.height) file << ',';
+        }
+        file << '\n';
+    }
+    
+    file << "    </data>\n";
+    file << "  </layer>\n";
+    file << "</map>\n";
     
-    return true;
+    std::string text = file.str();
+    return write_raw(out_path + "/" + base_name + ".tmx", text.data(), text.size());
 }
 
 Image generate_spritesheet(const Spriteset& sprites, const Palette& palette,
@@ -718,30 +988,25 @@ Image generate_spritesheet(const Spriteset& sprites, const Palette& palette,
         const auto& entry = sprites.entries[i];
         const auto& pixels = sprites.sprites[i];
         
-        copy_pixels(pixels, entry.w, entry.h, img.pixels, sheet_width, entry.x, entry.y);
+        copy_pixels(pixels.data(), pixels.size(), entry.w, entry.h,
+                    img.pixels, sheet_width, entry.x, entry.y);
     }
     
     return img;
 }
 
-bool export_fonts(const std::string& out_path) {
-    load_fonts();
-    if (g_font_credits.empty()) return false;
+bool Context::export_fonts(const std::string& out_path) {
+    auto fonts = load_fonts();
+    if (!fonts || fonts->num_tiles == 0) return false;
     
-    // Create font tileset
-    Tileset font_tiles;
-    font_tiles.tile_width = FONT_CREDITS_W;
-    font_tiles.tile_height = FONT_CREDITS_H;
-    font_tiles.num_tiles = static_cast<int>(g_font_credits.size());
-    font_tiles.tiles = g_font_credits;
+    Palette pal = load_palette_file(res_path + "/credits.pal");
     
-    Palette pal = load_palette_file(g_res_path + "/credits.pal");
-    
-    return generate_tileset(font_tiles, pal, NUM_FONT_CREDITS_CHARS, out_path, "FONTS");
+    return generate_tileset(*fonts, pal, NUM_FONT_CREDITS_CHARS, out_path, "FONTS",
+                            export_format, export_png_level);
 }
 
-bool convert_title(const std::string& resource, const std::string& out_path) {
-    std::string filename = g_sqz_path + "/" + resource + ".SQZ";
+bool Context::convert_title(const std::string& resource, const std::string& out_path) {
+    std::string filename = sqz_path + "/" + resource + ".SQZ";
     auto data = sqz::unpack(filename);
     
     const int width = 320;
@@ -769,54 +1034,247 @@ bool convert_title(const std::string& resource, const std::string& out_path) {
     }
     fg.palette = pal;
     
-    write_bmp(out_path + "/" + resource + "_B.bmp", bg);
-    write_bmp(out_path + "/" + resource + "_F.bmp", fg);
-    
-    return true;
+    return write_image(out_path + "/" + resource + "_B", bg, export_format, export_png_level) &&
+           write_image(out_path + "/" + resource + "_F", fg, export_format, export_png_level);
 }
 
-bool export_raw_sqz(const std::string& name, const std::string& out_path) {
+bool Context::export_raw_sqz(const std::string& name, const std::string& out_path) {
     try {
-        auto data = sqz::unpack(g_sqz_path + "/" + name + ".SQZ");
+        auto data = sqz::unpack(sqz_path + "/" + name + ".SQZ");
         return write_raw(out_path + "/" + name + ".BIN", data);
     } catch (...) {
         return false;
     }
 }
 
-bool prepare_all_assets(const std::string& cache_dir) {
-    create_directory(cache_dir);
-    
-    // Export fonts
-    export_fonts(cache_dir);
-    
-    // Convert 4bpp images with palettes
-    auto gameover = get_gameover_bitmap();
-    write_bmp(cache_dir + "/GAMEOVER.bmp", gameover);
-    
-    auto map = get_map_bitmap();
-    write_bmp(cache_dir + "/MAP.bmp", map);
+void Context::set_export_format(ImageFormat format, int png_level) {
+    export_format = format;
+    export_png_level = png_level;
+}
+
+// Export helpers for the pipeline, which reports failures as exceptions
+static void write_image_or_throw(const std::string& base_path, const Image& image,
+                                 const Palette& palette, ImageFormat format, int png_level) {
+    if (!write_image(base_path, image, palette, format, png_level)) {
+        throw std::runtime_error("Cannot write: " + base_path + image_extension(format));
+    }
+}
+
+static void write_image_or_throw(const std::string& base_path, const Image& image,
+                                 ImageFormat format, int png_level) {
+    write_image_or_throw(base_path, image, image.palette, format, png_level);
+}
+
+static void write_tileset_or_throw(const std::string& out_path, const std::string& base_name,
+                                   const Tileset& tiles, const Image& image,
+                                   ImageFormat format, int png_level) {
+    write_image_or_throw(out_path + "/" + base_name, image, format, png_level);
+    if (!write_tsx(base_name, out_path, tiles.tile_width, tiles.tile_height, image.width, image.height,
+                   format)) {
+        throw std::runtime_error("Cannot write: " + out_path + "/" + base_name + ".tsx");
+    }
+}
+
+util::TaskGraphReport Context::export_all(const std::string& out_path, unsigned threads,
+                                          const util::TaskGraph::Progress& progress) {
+    create_directory(out_path);
+    std::string raw_dir = out_path + "/RAW";
+    create_directory(raw_dir);
     
-    // Convert title
-    convert_title("PRESENT", cache_dir);
+    // Every decoded or converted asset lives in a slot written by exactly one
+    // task and read only by the tasks that depend on it
+    util::TaskGraph graph;
+    using TaskId = util::TaskGraph::TaskId;
+    ImageFormat format = export_format;
+    int png_level = export_png_level;
+    std::string ext = image_extension(format);
+    
+    // Screens: decode, then write
+    struct Screen {
+        const char* name;
+        Image (Context::*get)();
+    };
+    const Screen screens[] = {
+        {"TITUS", &Context::get_titus_bitmap},
+        {"MENU", &Context::get_menu_bitmap},
+        {"CASTLE", &Context::get_castle_bitmap},
+        {"THEEND", &Context::get_theend_bitmap},
+        {"MAP", &Context::get_map_bitmap},
+        {"GAMEOVER", &Context::get_gameover_bitmap},
+        {"CREDITS", &Context::get_credits_bitmap},
+        {"LEVELHI", &Context::get_dev_photo},
+    };
+    for (const Screen& screen : screens) {
+        auto image = std::make_shared<Image>();
+        std::string name = screen.name;
+        auto get = screen.get;
+        TaskId decoded = graph.add("decode", name, [this, image, get]() {
+            *image = (this->*get)();
+        });
+        graph.add("write", name + ext, [=]() {
+            write_image_or_throw(out_path + "/" + name, *image, format, png_level);
+        }, {decoded});
+    }
     
-    // Generate sprite sheet
-    auto sprites = get_sprites();
-    auto pal = get_level_palette(0);
-    auto sheet = generate_spritesheet(sprites, pal, 640, 480);
-    write_bmp(cache_dir + "/SPRITES.bmp", sheet);
+    graph.add("convert", "PRESENT", [this, out_path]() {
+        if (!convert_title("PRESENT", out_path)) {
+            throw std::runtime_error("Cannot write: " + out_path + "/PRESENT");
+        }
+    });
+    
+    // Shared tilesets: decode, lay out, write
+    auto add_tileset = [&](const std::string& name, std::function<std::shared_ptr<const Tileset>()> get,
+                           std::function<Palette()> palette, int tiles_per_row) {
+        auto tiles = std::make_shared<std::shared_ptr<const Tileset>>();
+        auto image = std::make_shared<Image>();
+        TaskId decoded = graph.add("decode", name, [=]() {
+            *tiles = get();
+            if (!*tiles || (*tiles)->num_tiles == 0) {
+                throw std::runtime_error("No tiles in " + name);
+            }
+        });
+        TaskId converted = graph.add("convert", name + " tileset", [=]() {
+            *image = build_tileset_image(**tiles, palette(), tiles_per_row);
+        }, {decoded});
+        graph.add("write", name + ext, [=]() {
+            write_tileset_or_throw(out_path, name, **tiles, *image, format, png_level);
+        }, {converted});
+        return std::make_pair(decoded, tiles);
+    };
+    
+    auto level_palette = [this]() { return get_level_palette(0); };
+    auto credits_palette = [this]() { return load_palette_file(res_path + "/credits.pal"); };
+    auto union_tiles = add_tileset("UNION", [this]() { return get_union_tiles(); },
+                                   level_palette, TILESET_COLUMNS);
+    add_tileset("FRONT", [this]() { return get_front_tiles(); }, level_palette, NUM_FRONT_TILES);
+    add_tileset("FONTS", [this]() { return load_fonts(); }, credits_palette, NUM_FONT_CREDITS_CHARS);
+    
+    // Sprites: decode, pack into a sheet, write
+    {
+        auto sprites = std::make_shared<std::shared_ptr<const Spriteset>>();
+        auto sheet = std::make_shared<Image>();
+        TaskId decoded = graph.add("decode", "SPRITES", [this, sprites]() {
+            *sprites = get_sprites();
+        });
+        TaskId converted = graph.add("convert", "SPRITES sheet", [this, sprites, sheet]() {
+            *sheet = generate_spritesheet(**sprites, get_level_palette(0), 640, 480);
+        }, {decoded});
+        graph.add("write", "SPRITES" + ext, [=]() {
+            write_image_or_throw(out_path + "/SPRITES", *sheet, format, png_level);
+        }, {converted});
+    }
     
-    // Generate front tileset
-    auto front = get_front_tiles();
-    generate_tileset(front, pal, NUM_FRONT_TILES, cache_dir, "FRONT");
+    // Levels: background, local tileset and a Tiled map referencing both
+    // the local and the union tiles
+    for (int level_idx = 0; level_idx < NUM_LEVELS; level_idx++) {
+        std::string name = std::string("LEVEL") + LEVEL_SUFFIXES[level_idx];
+        auto background = std::make_shared<std::shared_ptr<const Image>>();
+        auto level = std::make_shared<std::shared_ptr<const LevelData>>();
+        auto tiles_image = std::make_shared<Image>();
+        
+        TaskId back_decoded = graph.add("decode", name + " background", [=]() {
+            *background = get_level_background(level_idx);
+        });
+        graph.add("write", name + "_BACK" + ext, [=]() {
+            write_image_or_throw(out_path + "/" + name + "_BACK", **background, get_level_palette(level_idx),
+                                 format, png_level);
+        }, {back_decoded});
+        
+        TaskId level_decoded = graph.add("decode", name, [=]() {
+            *level = get_level_data(level_idx);
+        });
+        TaskId tiles_converted = graph.add("convert", name + " tileset", [=]() {
+            *tiles_image = build_tileset_image((*level)->local_tiles, get_level_palette(level_idx),
+                                               TILESET_COLUMNS);
+        }, {level_decoded});
+        graph.add("write", name + "_TILES" + ext, [=]() {
+            write_tileset_or_throw(out_path, name + "_TILES", (*level)->local_tiles, *tiles_image,
+                                   format, png_level);
+        }, {tiles_converted});
+        
+        auto shared_union = union_tiles.second;
+        graph.add("write", name + ".tmx", [=]() {
+            if (!write_tmx(name, out_path, **level, **shared_union)) {
+                throw std::runtime_error("Cannot write: " + out_path + "/" + name + ".tmx");
+            }
+        }, {level_decoded, union_tiles.first});
+    }
     
-    // Export raw files
-    std::string raw_dir = cache_dir + "/RAW";
-    create_directory(raw_dir);
-    export_raw_sqz("SAMPLE", raw_dir);
-    export_raw_sqz("KEYB", raw_dir);
+    for (const char* raw : {"SAMPLE", "KEYB"}) {
+        std::string name = raw;
+        graph.add("raw", name + ".BIN", [=]() {
+            if (!export_raw_sqz(name, raw_dir)) {
+                throw std::runtime_error("Cannot export: " + name);
+            }
+        });
+    }
     
-    return true;
+    util::ThreadPool pool(threads);
+    return graph.run(pool, progress);
+}
+
+bool Context::prepare_all_assets(const std::string& cache_dir) {
+    return export_all(cache_dir).failed == 0;
+}
+
+// ============================================================================
+// Default Context
+// ============================================================================
+
+Context& default_context() {
+    static Context context;
+    return context;
+}
+
+void set_sqz_path(const std::string& path) { default_context().set_sqz_path(path); }
+void set_res_path(const std::string& path) { default_context().set_res_path(path); }
+void set_cache_path(const std::string& path) { default_context().set_cache_path(path); }
+
+void load_level_palettes(const std::string& res_path) {
+    default_context().set_res_path(res_path);
+    default_context().load_level_palettes();
+}
+
+std::shared_ptr<const Image> get_level_background(int level_idx) { return default_context().get_level_background(level_idx); }
+std::shared_ptr<const LevelData> get_level_data(int level_idx) { return default_context().get_level_data(level_idx); }
+Palette get_level_palette(int level_idx) { return default_context().get_level_palette(level_idx); }
+
+Image get_titus_bitmap() { return default_context().get_titus_bitmap(); }
+Image get_menu_bitmap() { return default_context().get_menu_bitmap(); }
+Image get_castle_bitmap() { return default_context().get_castle_bitmap(); }
+Image get_theend_bitmap() { return default_context().get_theend_bitmap(); }
+Image get_map_bitmap() { return default_context().get_map_bitmap(); }
+Image get_gameover_bitmap() { return default_context().get_gameover_bitmap(); }
+Image get_credits_bitmap() { return default_context().get_credits_bitmap(); }
+Image get_year_bitmap() { return default_context().get_year_bitmap(); }
+Image get_dev_photo() { return default_context().get_dev_photo(); }
+
+std::shared_ptr<const Tileset> get_union_tiles() { return default_context().get_union_tiles(); }
+std::shared_ptr<const Tileset> get_front_tiles() { return default_context().get_front_tiles(); }
+std::shared_ptr<const Spriteset> get_sprites() { return default_context().get_sprites(); }
+
+std::vector<uint8_t> get_level_track(int level_idx) { return default_context().get_level_track(level_idx); }
+std::vector<uint8_t> get_intro_track() { return default_context().get_intro_track(); }
+std::vector<uint8_t> get_menu_track() { return default_context().get_menu_track(); }
+std::vector<uint8_t> get_gameover_track() { return default_context().get_gameover_track(); }
+std::vector<uint8_t> get_boss_track() { return default_context().get_boss_track(); }
+std::vector<uint8_t> get_bravo_track() { return default_context().get_bravo_track(); }
+std::vector<uint8_t> get_motif_track() { return default_context().get_motif_track(); }
+
+bool export_fonts(const std::string& out_path) {
+    return default_context().export_fonts(out_path);
+}
+
+bool convert_title(const std::string& resource, const std::string& out_path) {
+    return default_context().convert_title(resource, out_path);
+}
+
+bool prepare_all_assets(const std::string& cache_dir) {
+    return default_context().prepare_all_assets(cache_dir);
+}
+
+bool export_raw_sqz(const std::string& name, const std::string& out_path) {
+    return default_context().export_raw_sqz(name, out_path);
 }
 
 } // namespace assets
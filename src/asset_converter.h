@@ -1,15 +1,50 @@
 #pragma once
 
+#include "lru_cache.h"
+#include "png_writer.h"
+#include "task_graph.h"
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <cstddef>
 #include <array>
+#include <memory>
+#include <new>
 
 namespace assets {
 
+// Allocator returning Alignment-byte aligned storage, so pixel buffers can
+// be read with aligned SIMD loads and tiles never straddle a cache line
+template <typename T, size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+    
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+    
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+    
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+    
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+// 8bpp pixel storage aligned to a cache line
+using PixelBuffer = std::vector<uint8_t, AlignedAllocator<uint8_t, 64>>;
+
 // Palette: 256 colors, each with R, G, B
 struct Palette {
-    std::array<uint8_t, 256 * 3> colors;
+    std::array<uint8_t, 256 * 3> colors{};
     
     uint8_t r(int i) const { return colors[i * 3]; }
     uint8_t g(int i) const { return colors[i * 3 + 1]; }
@@ -35,12 +70,17 @@ struct Spriteset {
     std::vector<std::vector<uint8_t>> sprites;  // Each sprite pixels
 };
 
-// Tile data
+// Tile data: all tiles back to back in one contiguous atlas. Tile i starts
+// at tile(i) and its rows are tile_width bytes apart.
 struct Tileset {
     int tile_width = 16;
     int tile_height = 16;
     int num_tiles = 0;
-    std::vector<std::vector<uint8_t>> tiles;
+    PixelBuffer atlas;  // num_tiles * tile_stride() bytes, 8bpp indexed
+    
+    size_t tile_stride() const { return static_cast<size_t>(tile_width) * tile_height; }
+    const uint8_t* tile(int index) const { return atlas.data() + index * tile_stride(); }
+    uint8_t* tile(int index) { return atlas.data() + index * tile_stride(); }
 };
 
 // Level tilemap
@@ -51,29 +91,145 @@ struct Tilemap {
     std::vector<uint16_t> lut;
 };
 
-// Level data
+// Level data. The palette is not part of it: it comes from
+// get_level_palette(), so levels sharing data can differ in palette.
 struct LevelData {
     Tilemap tilemap;
     Tileset local_tiles;
-    Palette palette;
     std::vector<uint8_t> descriptors;
 };
 
 // Number of levels
 constexpr int NUM_LEVELS = 16;
 
-// Initialize asset paths
+// Image file formats written by the exporters
+enum class ImageFormat {
+    Bmp,  // 8bpp, uncompressed
+    Png   // Indexed, deflate compressed
+};
+
+class AssetRegistry;
+
+// One game installation: where its SQZ archives and resources live, where
+// its decoded assets are cached on disk, and every asset decoded from it.
+// Contexts share nothing, so one process can serve several installations or
+// mods side by side. Configure the paths first; after that every getter may
+// be called from any thread.
+class Context {
+public:
+    explicit Context(const std::string& sqz_dir = "sqz", const std::string& res_dir = "res",
+                     const std::string& cache_dir = "");
+    ~Context();
+    
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    
+    // Changing a path drops every asset decoded so far (handles already
+    // returned stay valid), so later getters read from the new location
+    void set_sqz_path(const std::string& path);
+    void set_res_path(const std::string& path);
+    
+    // Directory for decoded assets keyed by a hash of their source files.
+    // Warm loads skip decompression and conversion; empty disables the cache.
+    void set_cache_path(const std::string& path);
+    
+    // Decoded levels and backgrounds stay in memory in LRU caches bounded by
+    // these byte budgets, so revisiting a level does not decode it again
+    void set_level_cache_budget(size_t bytes);
+    void set_background_cache_budget(size_t bytes);
+    util::LruStats level_cache_stats() const;
+    util::LruStats background_cache_stats() const;
+    
+    // Read res/levels.pals now instead of on first use; throws if missing
+    void load_level_palettes();
+    
+    // Level backgrounds and data are handles to the cached, immutable
+    // copies; the background's own palette is unset, so draw both with
+    // get_level_palette()
+    std::shared_ptr<const Image> get_level_background(int level_idx);
+    std::shared_ptr<const LevelData> get_level_data(int level_idx);
+    Palette get_level_palette(int level_idx);
+    
+    // Screen images
+    Image get_titus_bitmap();
+    Image get_menu_bitmap();
+    Image get_castle_bitmap();
+    Image get_theend_bitmap();
+    Image get_map_bitmap();
+    Image get_gameover_bitmap();
+    
+    // Easter egg screens
+    Image get_credits_bitmap();
+    Image get_year_bitmap();
+    Image get_dev_photo();
+    
+    // Tile and sprite sets are decoded once per context; every call returns
+    // a handle to the same immutable copy
+    std::shared_ptr<const Tileset> get_union_tiles();
+    std::shared_ptr<const Tileset> get_front_tiles();
+    std::shared_ptr<const Spriteset> get_sprites();
+    
+    // Music track data (raw TRK file)
+    std::vector<uint8_t> get_level_track(int level_idx);
+    std::vector<uint8_t> get_intro_track();
+    std::vector<uint8_t> get_menu_track();
+    std::vector<uint8_t> get_gameover_track();
+    std::vector<uint8_t> get_boss_track();
+    std::vector<uint8_t> get_bravo_track();
+    std::vector<uint8_t> get_motif_track();
+    
+    // Image format of export_fonts, convert_title and export_all
+    // (BMP by default); png_level is used for PNG
+    void set_export_format(ImageFormat format, int png_level = png::DEFAULT_LEVEL);
+    
+    // Export tools reading from this installation
+    bool export_fonts(const std::string& out_path);
+    bool convert_title(const std::string& resource, const std::string& out_path);
+    
+    // Export every screen, tileset, sprite sheet and level (background,
+    // local tileset, TMX map) as a task graph: decode, convert and write
+    // stages of independent assets run in parallel on threads workers
+    // (0 = one per core). Images use the export format. Failed assets are
+    // listed in the report.
+    util::TaskGraphReport export_all(const std::string& out_path, unsigned threads = 0,
+                                     const util::TaskGraph::Progress& progress = nullptr);
+    
+    // export_all with default threads; true if nothing failed
+    bool prepare_all_assets(const std::string& cache_dir);
+    bool export_raw_sqz(const std::string& name, const std::string& out_path);
+    
+private:
+    std::string sqz_path;
+    std::string res_path;
+    std::string cache_path;
+    std::unique_ptr<AssetRegistry> registry;
+    ImageFormat export_format = ImageFormat::Bmp;
+    int export_png_level = png::DEFAULT_LEVEL;
+    
+    void reset_registry();
+    std::shared_ptr<const std::vector<Palette>> level_palettes();
+    std::shared_ptr<const Tileset> load_fonts();
+    Image get_index8_with_palette(const std::string& name);
+    Image get_index4_with_palette(const std::string& name, const std::string& pal_file);
+    std::vector<uint8_t> get_track_data(const std::string& name);
+};
+
+// The context behind the free functions below, rooted at "sqz" and "res"
+Context& default_context();
+
+// Initialize asset paths of the default context
 void set_sqz_path(const std::string& path);
 void set_res_path(const std::string& path);
+void set_cache_path(const std::string& path);
 
-// Load level palettes from res/levels.pals
+// Set the resource path and load level palettes from res/levels.pals
 void load_level_palettes(const std::string& res_path);
 
-// Get background image for a level
-Image get_level_background(int level_idx);
+// Get background image for a level (shared; palette from get_level_palette)
+std::shared_ptr<const Image> get_level_background(int level_idx);
 
-// Get level data
-LevelData get_level_data(int level_idx);
+// Get level data (shared)
+std::shared_ptr<const LevelData> get_level_data(int level_idx);
 
 // Get palette for a level
 Palette get_level_palette(int level_idx);
@@ -91,14 +247,10 @@ Image get_credits_bitmap();
 Image get_year_bitmap();
 Image get_dev_photo();
 
-// Load union tiles
-Tileset get_union_tiles();
-
-// Load front tiles
-Tileset get_front_tiles();
-
-// Load sprites
-Spriteset get_sprites();
+// Shared tile and sprite sets
+std::shared_ptr<const Tileset> get_union_tiles();
+std::shared_ptr<const Tileset> get_front_tiles();
+std::shared_ptr<const Spriteset> get_sprites();
 
 // Music track data (raw TRK file)
 std::vector<uint8_t> get_level_track(int level_idx);
@@ -113,25 +265,54 @@ std::vector<uint8_t> get_motif_track();
 // Export Tools
 // ============================================================================
 
+// File extension of a format, including the dot
+const char* image_extension(ImageFormat format);
+
+// Every writer builds the whole file in memory and writes it in one call
+
+// Encode image as an 8bpp BMP file, optionally with another palette
+std::vector<uint8_t> encode_bmp(const Image& image);
+std::vector<uint8_t> encode_bmp(const Image& image, const Palette& palette);
+
 // Write image as BMP file (simpler than PNG, no external deps)
 bool write_bmp(const std::string& filename, const Image& image);
 
+// Write image as indexed PNG file, level 0 (store) to 9 (smallest)
+bool write_png(const std::string& filename, const Image& image, int level = png::DEFAULT_LEVEL);
+
+// Write image to base_path plus the format's extension, optionally with
+// another palette
+bool write_image(const std::string& base_path, const Image& image, ImageFormat format,
+                 int png_level = png::DEFAULT_LEVEL);
+bool write_image(const std::string& base_path, const Image& image, const Palette& palette,
+                 ImageFormat format, int png_level = png::DEFAULT_LEVEL);
+
 // Write image as raw indexed pixels
 bool write_raw(const std::string& filename, const std::vector<uint8_t>& data);
+bool write_raw(const std::string& filename, const void* data, size_t size);
 
 // Generate tileset image and TSX file for Tiled editor
 bool generate_tileset(const Tileset& tiles, const Palette& palette, 
                       int tiles_per_row, const std::string& out_path, 
-                      const std::string& base_name);
+                      const std::string& base_name, ImageFormat format = ImageFormat::Bmp,
+                      int png_level = png::DEFAULT_LEVEL);
 
-// Write TSX (Tiled tileset) file
+// Write TSX (Tiled tileset) file referencing <base_name> in the given format
 bool write_tsx(const std::string& base_name, const std::string& out_path,
-               int tile_w, int tile_h, int image_w, int image_h);
+               int tile_w, int tile_h, int image_w, int image_h,
+               ImageFormat format = ImageFormat::Bmp);
+
+// Write a Tiled map (TMX) for a level. Tile ids refer to <base_name>_TILES.tsx
+// for the level's own tiles and UNION.tsx for the shared ones.
+bool write_tmx(const std::string& base_name, const std::string& out_path,
+               const LevelData& level, const Tileset& union_tiles);
 
 // Generate sprite sheet image
 Image generate_spritesheet(const Spriteset& sprites, const Palette& palette,
                            int sheet_width, int sheet_height);
 
+// The exports below read from the default context
+
 // Convert and export all fonts
 bool export_fonts(const std::string& out_path);
 
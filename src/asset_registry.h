@@ -0,0 +1,59 @@
+#pragma once
+
+#include "asset_converter.h"
+#include "lru_cache.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace assets {
+
+// One lazily built, immutable asset. The first caller runs the build while
+// concurrent callers of the same entry wait; other entries are not blocked,
+// and once built, readers never lock.
+// If the build throws, the exception propagates, the entry stays unbuilt and
+// the next get() retries.
+template <typename T>
+class RegistryEntry {
+public:
+    template <typename Build>
+    std::shared_ptr<const T> get(Build&& build) {
+        // value never changes once built is set, so readers skip the lock
+        if (built.load(std::memory_order_acquire)) return value;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!built.load(std::memory_order_relaxed)) {
+            value = std::make_shared<const T>(build());
+            built.store(true, std::memory_order_release);
+        }
+        return value;
+    }
+
+private:
+    std::mutex mutex;              // Held only while building
+    std::atomic<bool> built{false};
+    std::shared_ptr<const T> value;
+};
+
+// Default byte budgets of the decoded level and background caches
+constexpr size_t DEFAULT_LEVEL_CACHE_BUDGET = 32 * 1024 * 1024;
+constexpr size_t DEFAULT_BACKGROUND_CACHE_BUDGET = 16 * 1024 * 1024;
+
+// Assets decoded at most once per context and shared by every caller
+class AssetRegistry {
+public:
+    RegistryEntry<std::vector<Palette>> level_palettes;
+    RegistryEntry<Tileset> union_tiles;
+    RegistryEntry<Tileset> front_tiles;
+    RegistryEntry<Tileset> font_credits;
+    RegistryEntry<Spriteset> sprites;
+    
+    // Palette-less levels by level index and backgrounds by BACK suffix, so
+    // levels sharing a background decode it once
+    util::LruCache<int, LevelData> levels{DEFAULT_LEVEL_CACHE_BUDGET};
+    util::LruCache<std::string, Image> backgrounds{DEFAULT_BACKGROUND_CACHE_BUDGET};
+};
+
+} // namespace assets
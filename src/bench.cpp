@@ -0,0 +1,319 @@
+#include "sqz_unpacker.h"
+#include "sqz_packer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// Options
+// ============================================================================
+
+struct Options {
+    std::string dir = "sqz";
+    std::string json_path;
+    std::vector<std::string> files;
+    bool synthetic = false;          // Force synthetic inputs even if dir exists
+    size_t synthetic_size = 1000000; // TTF archives hold at most 0xFFFFF bytes
+    uint32_t seed = 1;
+    int warmup = 3;
+    int repetitions = 20;
+};
+
+static void print_usage(const char* argv0) {
+    std::cout << "Usage: " << argv0 << " [options] [files...]\n"
+              << "  --dir <path>       Archive directory (default: sqz)\n"
+              << "  --synthetic        Use generated inputs instead of real archives\n"
+              << "  --size <bytes>     Synthetic payload size (default: 1000000)\n"
+              << "  --seed <n>         Synthetic data seed (default: 1)\n"
+              << "  --warmup <n>       Untimed runs per input (default: 3)\n"
+              << "  --reps <n>         Timed runs per input (default: 20)\n"
+              << "  --json <file>      Also write results as JSON\n";
+}
+
+static bool parse_options(int argc, char* argv[], Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--dir" && has_value) {
+            opts.dir = argv[++i];
+        } else if (arg == "--synthetic") {
+            opts.synthetic = true;
+        } else if (arg == "--size" && has_value) {
+            opts.synthetic_size = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            opts.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--warmup" && has_value) {
+            opts.warmup = std::stoi(argv[++i]);
+        } else if (arg == "--reps" && has_value) {
+            opts.repetitions = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--json" && has_value) {
+            opts.json_path = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            opts.files.push_back(arg);
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Inputs
+// ============================================================================
+
+struct Input {
+    std::string name;
+    std::vector<uint8_t> archive;
+    sqz::ArchiveInfo info;
+    std::vector<uint8_t> expected;  // Every timed run must reproduce this
+};
+
+static std::vector<uint8_t> read_file(const std::string& filename) {
+    sqz::MappedFile file(filename);
+    return std::vector<uint8_t>(file.data(), file.data() + file.size());
+}
+
+// Game-like payload: 16-color planar graphics with long flat areas, tile
+// maps with small alphabets, and noisy blocks standing in for samples
+static std::vector<uint8_t> make_synthetic(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(size);
+    size_t pos = 0;
+
+    while (pos < size) {
+        size_t block = std::min<size_t>(size - pos, 256 + rng() % 4096);
+        switch (rng() % 4) {
+            case 0: {
+                // Flat fill
+                uint8_t value = static_cast<uint8_t>(rng() & 0x0F);
+                memset(&data[pos], value, block);
+                break;
+            }
+            case 1: {
+                // Small alphabet
+                for (size_t i = 0; i < block; i++) data[pos + i] = static_cast<uint8_t>(rng() % 6);
+                break;
+            }
+            case 2: {
+                // Repeat of earlier data
+                size_t distance = 1 + rng() % std::min<size_t>(pos + 1, 0x2000);
+                for (size_t i = 0; i < block; i++) {
+                    data[pos + i] = pos + i >= distance ? data[pos + i - distance] : 0;
+                }
+                break;
+            }
+            default: {
+                // Noise
+                for (size_t i = 0; i < block; i++) data[pos + i] = static_cast<uint8_t>(rng());
+                break;
+            }
+        }
+        pos += block;
+    }
+
+    return data;
+}
+
+static std::vector<Input> load_inputs(const Options& opts) {
+    std::vector<Input> inputs;
+    std::vector<std::string> files = opts.files;
+
+    if (files.empty() && !opts.synthetic && std::filesystem::is_directory(opts.dir)) {
+        for (const auto& entry : std::filesystem::directory_iterator(opts.dir)) {
+            if (entry.is_regular_file() && sqz::is_archive_name(entry.path().string())) {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    }
+
+    for (const auto& filename : files) {
+        Input input;
+        input.name = std::filesystem::path(filename).filename().string();
+        input.archive = read_file(filename);
+        input.info = sqz::probe(input.archive.data(), input.archive.size());
+        // The streaming decoder shares no code path with unpack_into
+        sqz::unpack_chunked(input.archive.data(), input.archive.size(), 0x10000,
+                            [&](const uint8_t* data, size_t size) {
+                                input.expected.insert(input.expected.end(), data, data + size);
+                            });
+        inputs.push_back(std::move(input));
+    }
+
+    if (inputs.empty()) {
+        auto payload = make_synthetic(opts.synthetic_size, opts.seed);
+        const sqz::Format formats[] = {sqz::Format::Lzw, sqz::Format::HuffmanRle, sqz::Format::Diet};
+        const char* names[] = {"synthetic.lzw", "synthetic.huffman", "synthetic.diet"};
+        for (int i = 0; i < 3; i++) {
+            Input input;
+            input.name = names[i];
+            input.archive = sqz::pack(formats[i], payload.data(), payload.size());
+            input.info = sqz::probe(input.archive.data(), input.archive.size());
+            input.expected = payload;
+            inputs.push_back(std::move(input));
+        }
+    }
+
+    return inputs;
+}
+
+// ============================================================================
+// Measurement
+// ============================================================================
+
+struct Result {
+    std::string name;
+    const char* format;
+    size_t packed_size;
+    size_t payload_size;
+    std::vector<double> ns;  // Sorted per-run times
+};
+
+static const char* format_name(sqz::Format format) {
+    switch (format) {
+        case sqz::Format::Lzw: return "lzw";
+        case sqz::Format::HuffmanRle: return "huffman";
+        case sqz::Format::Diet: return "diet";
+    }
+    return "?";
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    double rank = p * (sorted.size() - 1);
+    size_t lo = static_cast<size_t>(rank);
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+static double mb_per_s(size_t bytes, double ns) {
+    return ns > 0 ? bytes / ns * 1e9 / (1024.0 * 1024.0) : 0;
+}
+
+// Throws unless the last run wrote exactly the expected payload
+static void verify(const Input& input, const std::vector<uint8_t>& output, size_t written) {
+    if (written != input.expected.size() ||
+        (written > 0 && memcmp(output.data(), input.expected.data(), written) != 0)) {
+        throw std::runtime_error(input.name + ": decoded output does not match the reference");
+    }
+}
+
+static Result measure(const Input& input, const Options& opts) {
+    std::vector<uint8_t> output(input.info.payload_size + 64);
+    const uint8_t* src = input.archive.data();
+    size_t src_size = input.archive.size();
+
+    for (int i = 0; i < opts.warmup; i++) {
+        std::fill(output.begin(), output.end(), 0xCD);
+        verify(input, output, sqz::unpack_into(src, src_size, output.data(), output.size()));
+    }
+
+    Result result;
+    result.name = input.name;
+    result.format = format_name(input.info.format);
+    result.packed_size = src_size;
+    result.payload_size = input.info.payload_size;
+
+    for (int i = 0; i < opts.repetitions; i++) {
+        // Stale output from the previous run must not pass verification
+        std::fill(output.begin(), output.end(), 0xCD);
+        auto start = std::chrono::steady_clock::now();
+        size_t written = sqz::unpack_into(src, src_size, output.data(), output.size());
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        verify(input, output, written);
+        result.ns.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+    }
+
+    std::sort(result.ns.begin(), result.ns.end());
+    return result;
+}
+
+// ============================================================================
+// Reporting
+// ============================================================================
+
+static void print_results(const std::vector<Result>& results) {
+    std::cout << std::left << std::setw(20) << "input" << std::setw(9) << "format"
+              << std::right << std::setw(10) << "packed" << std::setw(10) << "payload"
+              << std::setw(10) << "MB/s" << std::setw(10) << "ns/byte"
+              << std::setw(10) << "p10 ms" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << "\n";
+
+    for (const auto& r : results) {
+        double median = percentile(r.ns, 0.5);
+        std::cout << std::left << std::setw(20) << r.name << std::setw(9) << r.format
+                  << std::right << std::setw(10) << r.packed_size << std::setw(10) << r.payload_size
+                  << std::fixed << std::setprecision(1) << std::setw(10) << mb_per_s(r.payload_size, median)
+                  << std::setprecision(3) << std::setw(10) << (r.payload_size ? median / r.payload_size : 0)
+                  << std::setw(10) << percentile(r.ns, 0.1) / 1e6
+                  << std::setw(10) << median / 1e6
+                  << std::setw(10) << percentile(r.ns, 0.9) / 1e6
+                  << "\n";
+    }
+}
+
+static bool write_json(const std::string& filename, const std::vector<Result>& results, const Options& opts) {
+    std::ofstream file(filename);
+    if (!file) return false;
+
+    file << "{\n  \"warmup\": " << opts.warmup << ",\n  \"repetitions\": " << opts.repetitions
+         << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        double median = percentile(r.ns, 0.5);
+        file << std::fixed << std::setprecision(3)
+             << "    {\"input\": \"" << r.name << "\", \"format\": \"" << r.format << "\""
+             << ", \"packed_bytes\": " << r.packed_size
+             << ", \"payload_bytes\": " << r.payload_size
+             << ", \"mb_per_s\": " << mb_per_s(r.payload_size, median)
+             << ", \"ns_per_byte\": " << (r.payload_size ? median / r.payload_size : 0)
+             << ", \"min_ns\": " << r.ns.front()
+             << ", \"p10_ns\": " << percentile(r.ns, 0.1)
+             << ", \"p50_ns\": " << median
+             << ", \"p90_ns\": " << percentile(r.ns, 0.9)
+             << ", \"p99_ns\": " << percentile(r.ns, 0.99)
+             << ", \"max_ns\": " << r.ns.back() << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parse_options(argc, argv, opts)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+#ifndef NDEBUG
+    std::cerr << "Warning: unoptimized build; configure with -DCMAKE_BUILD_TYPE=Release" << std::endl;
+#endif
+
+    try {
+        std::vector<Result> results;
+        for (const auto& input : load_inputs(opts)) {
+            results.push_back(measure(input, opts));
+        }
+
+        print_results(results);
+
+        if (!opts.json_path.empty() && !write_json(opts.json_path, results, opts)) {
+            std::cerr << "Cannot write: " << opts.json_path << std::endl;
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
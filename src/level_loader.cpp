@@ -0,0 +1,77 @@
+#include "level_loader.h"
+#include <chrono>
+
+namespace assets {
+
+LevelLoader::LevelLoader(Context& context, unsigned threads)
+    : context(context), pool(threads) {}
+
+void LevelLoader::prefetch(int level_idx) {
+    if (level_idx < 0 || level_idx >= NUM_LEVELS) return;
+    request(level_idx);
+}
+
+std::shared_ptr<const LoadedLevel> LevelLoader::try_get(int level_idx) {
+    Pending pending = request(level_idx);
+    if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return nullptr;
+    }
+    return finish(level_idx, pending);
+}
+
+std::shared_ptr<const LoadedLevel> LevelLoader::get(int level_idx) {
+    return finish(level_idx, request(level_idx));
+}
+
+void LevelLoader::retain(int first, int last) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = levels.begin(); it != levels.end();) {
+        if (it->first < first || it->first > last) {
+            it = levels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+LevelLoader::Pending LevelLoader::request(int level_idx) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = levels.find(level_idx);
+    if (it != levels.end()) {
+        return it->second;
+    }
+
+    Pending pending = pool.submit([this, level_idx]() { return load(level_idx); }).share();
+    levels.emplace(level_idx, pending);
+    return pending;
+}
+
+// A failed level is forgotten so the next request retries it
+std::shared_ptr<const LoadedLevel> LevelLoader::finish(int level_idx, const Pending& pending) {
+    try {
+        return pending.get();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        levels.erase(level_idx);
+        throw;
+    }
+}
+
+// Runs on a worker; touches only the (thread-safe) context
+std::shared_ptr<const LoadedLevel> LevelLoader::load(int level_idx) {
+    auto level = std::make_shared<LoadedLevel>();
+    level->index = level_idx;
+    level->background = context.get_level_background(level_idx);
+    level->data = context.get_level_data(level_idx);
+    level->union_tiles = context.get_union_tiles();
+    level->palette = context.get_level_palette(level_idx);
+
+    // Missing music is not fatal; the level plays silently
+    try {
+        level->track = context.get_level_track(level_idx);
+    } catch (...) {}
+
+    return level;
+}
+
+} // namespace assets
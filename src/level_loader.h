@@ -0,0 +1,62 @@
+#pragma once
+
+#include "asset_converter.h"
+#include "thread_pool.h"
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace assets {
+
+// Everything the game needs to show one level
+struct LoadedLevel {
+    int index = 0;
+    std::shared_ptr<const Image> background;     // Shared with the context's caches
+    std::shared_ptr<const LevelData> data;
+    std::shared_ptr<const Tileset> union_tiles;  // From the same context as data
+    Palette palette;                             // For both background and tiles
+    std::vector<uint8_t> track;                  // Empty if the level has no music
+};
+
+// Decodes levels on worker threads so the main loop never waits for
+// unpacking. Levels are requested by index; finished ones are kept until
+// retain() drops them.
+class LevelLoader {
+public:
+    // The context must outlive the loader
+    explicit LevelLoader(Context& context, unsigned threads = 2);
+
+    LevelLoader(const LevelLoader&) = delete;
+    LevelLoader& operator=(const LevelLoader&) = delete;
+
+    // Start decoding a level in the background unless it is already loaded
+    // or in flight. Out-of-range indices are ignored.
+    void prefetch(int level_idx);
+
+    // The level if it has finished decoding, otherwise nullptr (and the
+    // level is queued). Never blocks; rethrows the decoder's exception if
+    // the level failed to load.
+    std::shared_ptr<const LoadedLevel> try_get(int level_idx);
+
+    // Wait for the level to finish decoding
+    std::shared_ptr<const LoadedLevel> get(int level_idx);
+
+    // Forget levels outside [first, last]; in-flight ones finish unobserved
+    void retain(int first, int last);
+
+private:
+    using Pending = std::shared_future<std::shared_ptr<const LoadedLevel>>;
+
+    Context& context;
+    std::mutex mutex;
+    std::map<int, Pending> levels;
+    util::ThreadPool pool;  // Last, so workers are joined first
+
+    Pending request(int level_idx);
+    std::shared_ptr<const LoadedLevel> finish(int level_idx, const Pending& pending);
+    std::shared_ptr<const LoadedLevel> load(int level_idx);
+};
+
+} // namespace assets
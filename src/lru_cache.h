@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace util {
+
+struct LruStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+};
+
+// Thread-safe least-recently-used cache of immutable values, bounded by the
+// byte sizes given on insert. The newest entry is always kept, even if it
+// alone exceeds the budget.
+template <typename Key, typename Value>
+class LruCache {
+public:
+    explicit LruCache(size_t budget_bytes) { counters.budget = budget_bytes; }
+
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+
+    // The cached value, or nullptr; a hit makes the entry most recent
+    std::shared_ptr<const Value> find(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            counters.misses++;
+            return nullptr;
+        }
+        counters.hits++;
+        order.splice(order.begin(), order, it->second);
+        return it->second->value;
+    }
+
+    // Add a value, evicting the least recently used entries to fit. If
+    // another thread inserted the key first, its value is kept and returned.
+    std::shared_ptr<const Value> insert(const Key& key, std::shared_ptr<const Value> value, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            order.splice(order.begin(), order, it->second);
+            return it->second->value;
+        }
+
+        order.push_front(Entry{key, std::move(value), bytes});
+        index.emplace(key, order.begin());
+        counters.bytes += bytes;
+        evict();
+        return order.front().value;
+    }
+
+    // Find, or build and insert. Two threads missing the same key may both
+    // build it; the first insert wins.
+    template <typename Build, typename Size>
+    std::shared_ptr<const Value> get(const Key& key, Build&& build, Size&& size_of) {
+        if (auto value = find(key)) return value;
+        auto value = std::make_shared<const Value>(build());
+        size_t bytes = size_of(*value);
+        return insert(key, std::move(value), bytes);
+    }
+
+    void set_budget(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.budget = budget_bytes;
+        evict();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.clear();
+        index.clear();
+        counters.bytes = 0;
+    }
+
+    LruStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        LruStats result = counters;
+        result.entries = order.size();
+        return result;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::shared_ptr<const Value> value;
+        size_t bytes;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> order;  // Most recent first
+    std::unordered_map<Key, typename std::list<Entry>::iterator> index;
+    LruStats counters;
+
+    void evict() {
+        while (counters.bytes > counters.budget && order.size() > 1) {
+            const Entry& oldest = order.back();
+            counters.bytes -= oldest.bytes;
+            counters.evictions++;
+            index.erase(oldest.key);
+            order.pop_back();
+        }
+    }
+};
+
+} // namespace util
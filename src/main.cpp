@@ -1,8 +1,16 @@
 #include "asset_converter.h"
+#include "level_loader.h"
 #include "renderer.h"
 #include "audio.h"
+#include "sqz_unpacker.h"
+#include "sqz_packer.h"
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <cctype>
 #include <cmath>
+#include <string>
 
 // Game state
 enum class GameState {
@@ -21,6 +29,12 @@ public:
     GameState state = GameState::Titus;
     int current_level = 0;
     
+    // Levels decode in the background; shown_level is on screen (-1 for a
+    // still screen) and pending_level is waiting for its assets (-1 for none)
+    assets::LevelLoader loader{assets::default_context()};
+    int shown_level = -1;
+    int pending_level = -1;
+    
     // Scroll with inertia
     float scroll_x = 0, scroll_y = 0;
     float speed_x = 0, speed_y = 0;
@@ -28,10 +42,17 @@ public:
     const float MAX_SPEED = 1.0f;
     const float MOVE_SPEED = 3.0f;
     
+    // Levels fade in from black over 256 / FADE_STEP frames (indexed
+    // rendering only; direct rendering ignores the fade)
+    int fade = 256;
+    const int FADE_STEP = 8;
+    
     bool running = true;
     
-    bool init() {
+    // cache_dir enables the on-disk decoded-asset cache; empty disables it
+    bool init(const std::string& cache_dir) {
         assets::set_sqz_path("sqz");
+        assets::set_cache_path(cache_dir);
         assets::load_level_palettes("res");
         
         if (!render.init("Prehistorik 2 - C++ SDL2")) {
@@ -50,14 +71,11 @@ public:
         audio::shutdown();
     }
     
-    void play_level_music(int level_idx) {
-        try {
-            auto track = assets::get_level_track(level_idx);
-            if (!audio::play_track_data(track)) {
-                std::cout << "Failed to play level music" << std::endl;
-            }
-        } catch (...) {
-            std::cout << "No music for level " << (level_idx + 1) << std::endl;
+    void play_level_music(const assets::LoadedLevel& level) {
+        if (level.track.empty()) {
+            std::cout << "No music for level " << (level.index + 1) << std::endl;
+        } else if (!audio::play_track_data(level.track)) {
+            std::cout << "Failed to play level music" << std::endl;
         }
     }
     
@@ -95,27 +113,71 @@ public:
         return speed;
     }
     
+    // Request a level; poll_level() shows it once its assets are decoded
     void load_level(int idx) {
         if (idx < 0) idx = 0;
         if (idx >= assets::NUM_LEVELS) idx = assets::NUM_LEVELS - 1;
         
         current_level = idx;
-        scroll_x = scroll_y = 0;
-        speed_x = speed_y = 0;
+        if (idx == pending_level) return;
+        
+        // The level on screen is already decoded: restart it from the top
+        // left and drop any other level still on its way
+        if (idx == shown_level) {
+            scroll_x = scroll_y = 0;
+            speed_x = speed_y = 0;
+            pending_level = -1;
+            return;
+        }
         
         std::cout << "Loading level " << (idx + 1) << "..." << std::endl;
+        pending_level = idx;
+        loader.prefetch(idx);
+    }
+    
+    // Called every frame: show the pending level if it is ready, then start
+    // decoding its neighbours so PgUp/PgDn switch instantly
+    void poll_level() {
+        if (pending_level < 0) return;
+        
+        std::shared_ptr<const assets::LoadedLevel> level;
+        try {
+            level = loader.try_get(pending_level);
+        } catch (const std::exception& e) {
+            std::cout << "Cannot load level " << (pending_level + 1) << ": " << e.what() << std::endl;
+            pending_level = -1;
+            return;
+        }
+        if (!level) return;
         
-        auto background = assets::get_level_background(idx);
-        render.set_background(background);
+        scroll_x = scroll_y = 0;
+        speed_x = speed_y = 0;
         
-        auto level_data = assets::get_level_data(idx);
-        render.set_tilemap(level_data);
+        render.set_background(level->background, level->palette);
+        render.set_tilemap(level->data, level->union_tiles, level->palette);
+        fade = 0;
+        render.set_fade(fade);
+        play_level_music(*level);
         
-        play_level_music(idx);
+        shown_level = level->index;
+        pending_level = -1;
+        
+        loader.retain(shown_level - 1, shown_level + 1);
+        loader.prefetch(shown_level - 1);
+        loader.prefetch(shown_level + 1);
+    }
+    
+    // Switching to a still screen cancels any level on screen or on its way
+    void leave_level() {
+        shown_level = -1;
+        pending_level = -1;
+        fade = 256;
+        render.set_fade(fade);
     }
     
     void show_titus() {
         std::cout << "Showing Titus screen..." << std::endl;
+        leave_level();
         auto titus = assets::get_titus_bitmap();
         render.set_background(titus);
         render.clear_tilemap();
@@ -125,6 +187,7 @@ public:
     
     void show_menu() {
         std::cout << "Showing Menu..." << std::endl;
+        leave_level();
         try {
             auto menu = assets::get_menu_bitmap();
             render.set_background(menu);
@@ -136,6 +199,7 @@ public:
     
     void show_credits() {
         std::cout << "Showing Credits..." << std::endl;
+        leave_level();
         try {
             auto credits = assets::get_credits_bitmap();
             render.set_background(credits);
@@ -146,6 +210,7 @@ public:
     
     void show_theend() {
         std::cout << "Showing The End..." << std::endl;
+        leave_level();
         try {
             auto theend = assets::get_theend_bitmap();
             render.set_background(theend);
@@ -156,6 +221,7 @@ public:
     
     void show_gameover() {
         std::cout << "Game Over..." << std::endl;
+        leave_level();
         try {
             auto gameover = assets::get_gameover_bitmap();
             render.set_background(gameover);
@@ -168,10 +234,13 @@ public:
     
     void run() {
         show_titus();
+        loader.prefetch(current_level);
         
         bool space_was_pressed = false;
         bool pgup_was_pressed = false;
         bool pgdn_was_pressed = false;
+        bool f2_was_pressed = false;
+        bool f3_was_pressed = false;
         
         std::cout << "\nControls:" << std::endl;
         std::cout << "  Arrow keys: Scroll" << std::endl;
@@ -180,6 +249,8 @@ public:
         std::cout << "  1-9, A-G: Jump to level" << std::endl;
         std::cout << "  M: Menu, C: Credits, E: TheEnd, G: GameOver" << std::endl;
         std::cout << "  +/-: Volume" << std::endl;
+        std::cout << "  F2: Toggle tilemap renderer (chunks/atlas)" << std::endl;
+        std::cout << "  F3: Toggle indexed-color rendering" << std::endl;
         std::cout << "  ESC: Quit" << std::endl;
         
         int volume = 100;
@@ -189,6 +260,20 @@ public:
                                   render.is_key_down(SDL_SCANCODE_RETURN);
             bool pgup_pressed = render.is_key_down(SDL_SCANCODE_PAGEUP);
             bool pgdn_pressed = render.is_key_down(SDL_SCANCODE_PAGEDOWN);
+            bool f2_pressed = render.is_key_down(SDL_SCANCODE_F2);
+            
+            if (f2_pressed && !f2_was_pressed) {
+                bool atlas = render.get_tilemap_mode() == renderer::Renderer::TilemapMode::Atlas;
+                render.set_tilemap_mode(atlas ? renderer::Renderer::TilemapMode::Chunks
+                                              : renderer::Renderer::TilemapMode::Atlas);
+                std::cout << "Tilemap renderer: " << (atlas ? "chunks" : "atlas") << std::endl;
+            }
+            
+            bool f3_pressed = render.is_key_down(SDL_SCANCODE_F3);
+            if (f3_pressed && !f3_was_pressed) {
+                render.set_indexed(!render.is_indexed());
+                std::cout << "Indexed rendering: " << (render.is_indexed() ? "on" : "off") << std::endl;
+            }
             
             // Volume control
             if (render.is_key_down(SDL_SCANCODE_EQUALS) || render.is_key_down(SDL_SCANCODE_KP_PLUS)) {
@@ -266,19 +351,180 @@ public:
                     break;
             }
             
+            poll_level();
+            if (fade < 256) {
+                fade = std::min(256, fade + FADE_STEP);
+                render.set_fade(fade);
+            }
+            
             space_was_pressed = space_pressed;
             pgup_was_pressed = pgup_pressed;
             pgdn_was_pressed = pgdn_pressed;
+            f2_was_pressed = f2_pressed;
+            f3_was_pressed = f3_pressed;
             
             render.render();
         }
     }
 };
 
+static const char* format_name(sqz::Format format) {
+    switch (format) {
+        case sqz::Format::Lzw: return "LZW";
+        case sqz::Format::HuffmanRle: return "Huffman";
+        case sqz::Format::Diet: return "DIET";
+    }
+    return "?";
+}
+
+// Decode every archive in dir and print per-file timings
+static int run_unpack_all(const std::string& dir, unsigned threads) {
+    auto start = std::chrono::steady_clock::now();
+    auto results = sqz::unpack_all(dir, threads);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    
+    int failures = 0;
+    double cpu_ms = 0;
+    size_t total_bytes = 0;
+    
+    for (const auto& entry : results) {
+        const auto& result = entry.second;
+        std::cout << std::left << std::setw(14) << entry.first;
+        if (result.error.empty()) {
+            std::cout << std::setw(9) << format_name(result.info.format)
+                      << std::right << std::setw(9) << result.data.size() << " bytes "
+                      << std::fixed << std::setprecision(2) << std::setw(9) << result.milliseconds << " ms"
+                      << std::endl;
+            total_bytes += result.data.size();
+        } else {
+            std::cout << "FAILED: " << result.error << std::endl;
+            failures++;
+        }
+        cpu_ms += result.milliseconds;
+    }
+    
+    double wall_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    std::cout << results.size() << " files, " << total_bytes << " bytes, "
+              << std::fixed << std::setprecision(2) << wall_ms << " ms wall, "
+              << cpu_ms << " ms summed" << std::endl;
+    
+    return failures == 0 ? 0 : 1;
+}
+
+// Export every asset in parallel and print per-stage timings
+static int run_export(const std::string& out_dir, unsigned threads, const std::string& format) {
+    assets::Context& context = assets::default_context();
+    if (format == "bmp") {
+        context.set_export_format(assets::ImageFormat::Bmp);
+    } else if (format.size() == 4 && format.compare(0, 3, "png") == 0 && std::isdigit(static_cast<unsigned char>(format[3]))) {
+        context.set_export_format(assets::ImageFormat::Png, format[3] - '0');
+    } else if (format == "png") {
+        context.set_export_format(assets::ImageFormat::Png);
+    } else {
+        std::cerr << "Unknown format: " << format << " (bmp, png, png0-png9)" << std::endl;
+        return 1;
+    }
+    
+    size_t last_percent = 0;
+    auto report = context.export_all(out_dir, threads, [&](size_t done, size_t total, const std::string&) {
+        size_t percent = done * 100 / total;
+        if (percent >= last_percent + 10 || done == total) {
+            std::cout << "  " << done << "/" << total << " tasks (" << percent << "%)" << std::endl;
+            last_percent = percent;
+        }
+    });
+    
+    std::cout << std::left << std::setw(10) << "stage" << std::right << std::setw(7) << "tasks"
+              << std::setw(8) << "failed" << std::setw(9) << "skipped"
+              << std::setw(11) << "busy ms" << std::setw(11) << "max ms" << std::endl;
+    for (const auto& stage : report.stages) {
+        std::cout << std::left << std::setw(10) << stage.name << std::right << std::setw(7) << stage.tasks
+                  << std::setw(8) << stage.failed << std::setw(9) << stage.skipped
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(11) << stage.busy_ms << std::setw(11) << stage.max_ms << std::endl;
+    }
+    for (const auto& error : report.errors) {
+        std::cout << "FAILED: " << error << std::endl;
+    }
+    std::cout << report.tasks << " tasks, " << report.failed << " failed, " << report.skipped
+              << " skipped, " << std::fixed << std::setprecision(2) << report.wall_ms << " ms wall" << std::endl;
+    
+    return report.failed == 0 ? 0 : 1;
+}
+
+// Compress a raw file into an SQZ archive
+static int run_pack(const std::string& method, const std::string& input, const std::string& output) {
+    std::ifstream in(input, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open: " << input << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+    
+    std::vector<uint8_t> packed;
+    if (method == "lzw") {
+        packed = sqz::pack_lzw(data.data(), data.size());
+    } else if (method == "lzw-alt") {
+        packed = sqz::pack_lzw(data.data(), data.size(), true);
+    } else if (method == "huffman") {
+        packed = sqz::pack_huffman_rle(data.data(), data.size());
+    } else if (method == "diet") {
+        packed = sqz::pack_diet(data.data(), data.size());
+    } else {
+        std::cerr << "Unknown method: " << method << " (lzw, lzw-alt, huffman, diet)" << std::endl;
+        return 1;
+    }
+    
+    std::ofstream out(output, std::ios::binary);
+    if (!out) {
+        std::cerr << "Cannot create: " << output << std::endl;
+        return 1;
+    }
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+    
+    std::cout << input << ": " << data.size() << " -> " << packed.size() << " bytes" << std::endl;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     try {
+        // Batch mode: pre2 --unpack-all [dir] [threads]
+        if (argc > 1 && std::string(argv[1]) == "--unpack-all") {
+            std::string dir = argc > 2 ? argv[2] : "sqz";
+            unsigned threads = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 0;
+            return run_unpack_all(dir, threads);
+        }
+        
+        // Export: pre2 --export [out_dir] [threads] [bmp|png|png0-png9]
+        if (argc > 1 && std::string(argv[1]) == "--export") {
+            std::string out_dir = argc > 2 ? argv[2] : "export";
+            unsigned threads = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 0;
+            std::string format = argc > 4 ? argv[4] : "png";
+            return run_export(out_dir, threads, format);
+        }
+        
+        // Repack: pre2 --pack <lzw|lzw-alt|huffman|diet> <input> <output>
+        if (argc > 1 && std::string(argv[1]) == "--pack") {
+            if (argc < 5) {
+                std::cerr << "Usage: " << argv[0] << " --pack <lzw|lzw-alt|huffman|diet> <input> <output>" << std::endl;
+                return 1;
+            }
+            return run_pack(argv[2], argv[3], argv[4]);
+        }
+        
+        // Play: pre2 [--cache <dir>]
+        std::string cache_dir;
+        if (argc > 1 && std::string(argv[1]) == "--cache") {
+            if (argc < 3) {
+                std::cerr << "Usage: " << argv[0] << " --cache <dir>" << std::endl;
+                return 1;
+            }
+            cache_dir = argv[2];
+        }
+        
         Game game;
-        if (!game.init()) {
+        if (!game.init(cache_dir)) {
             std::cerr << "Failed to initialize" << std::endl;
             return 1;
         }
@@ -0,0 +1,420 @@
+#include "pixel_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// SSE2 is part of the x86-64 baseline; 32-bit builds need it enabled
+#if defined(KERNELS_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define KERNELS_SSE2 1
+#endif
+
+// AVX2 code is compiled per function so the rest of the tree keeps the
+// baseline ISA; it only runs after the CPU check passes
+#if defined(KERNELS_SSE2) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define KERNELS_AVX2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+namespace kernels {
+
+// ============================================================================
+// CPU Detection
+// ============================================================================
+
+static bool cpu_has_avx2() {
+#if defined(KERNELS_AVX2) && defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#elif defined(KERNELS_AVX2)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+Isa detect_isa() {
+    static const Isa isa = []() {
+        if (cpu_has_avx2()) return Isa::Avx2;
+#ifdef KERNELS_SSE2
+        return Isa::Sse2;
+#else
+        return Isa::Scalar;
+#endif
+    }();
+    return isa;
+}
+
+const char* isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::Scalar: return "scalar";
+        case Isa::Sse2: return "sse2";
+        case Isa::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+// ============================================================================
+// Planar Conversion
+// ============================================================================
+
+// Output byte j of plane position i packs pixels 2j and 2j+1, each built
+// from one bit of every plane. Viewing the four plane bytes as a 32-bit
+// word b0 | b1 << 8 | b2 << 16 | b3 << 24, the output word is a fixed bit
+// permutation of it, done below as four delta swaps. The kernels then
+// split each packed byte into two pixels.
+
+// Reference implementations, also used for tails
+static void planar_to_indexed_scalar(const uint8_t* src, size_t plane_length,
+                                     size_t begin, uint8_t* dst) {
+    for (size_t i = begin; i < plane_length; i++) {
+        uint8_t b0 = src[plane_length * 0 + i];
+        uint8_t b1 = src[plane_length * 1 + i];
+        uint8_t b2 = src[plane_length * 2 + i];
+        uint8_t b3 = src[plane_length * 3 + i];
+
+        for (int p = 0; p < 8; p++) {
+            int bit = 7 - p;
+            dst[i * 8 + p] = static_cast<uint8_t>(((b0 >> bit) & 1) | (((b1 >> bit) & 1) << 1) |
+                                                  (((b2 >> bit) & 1) << 2) | (((b3 >> bit) & 1) << 3));
+        }
+    }
+}
+
+#ifdef KERNELS_SSE2
+
+// Swap the bits selected by mask with the bits delta positions above them
+static inline __m128i delta_swap_sse2(__m128i x, int delta, __m128i mask) {
+    __m128i t = _mm_and_si128(_mm_xor_si128(_mm_srli_epi32(x, delta), x), mask);
+    return _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi32(t, delta));
+}
+
+static inline __m128i transpose_planes_sse2(__m128i x) {
+    x = delta_swap_sse2(x, 20, _mm_set1_epi32(0x00000F0F));
+    x = delta_swap_sse2(x, 10, _mm_set1_epi32(0x00330033));
+    x = delta_swap_sse2(x, 3, _mm_set1_epi32(0x0A0A0A0A));
+    x = delta_swap_sse2(x, 3, _mm_set1_epi32(0x11111111));
+    return x;
+}
+
+// Linear 4bpp bytes for positions i to i + 15, in order
+static inline void load_linear_sse2(const uint8_t* src, size_t plane_length, size_t i, __m128i out[4]) {
+    __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + plane_length + i));
+    __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + plane_length * 2 + i));
+    __m128i b3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + plane_length * 3 + i));
+
+    // Gather one 32-bit word per position
+    __m128i b01_lo = _mm_unpacklo_epi8(b0, b1);
+    __m128i b01_hi = _mm_unpackhi_epi8(b0, b1);
+    __m128i b23_lo = _mm_unpacklo_epi8(b2, b3);
+    __m128i b23_hi = _mm_unpackhi_epi8(b2, b3);
+
+    out[0] = transpose_planes_sse2(_mm_unpacklo_epi16(b01_lo, b23_lo));
+    out[1] = transpose_planes_sse2(_mm_unpackhi_epi16(b01_lo, b23_lo));
+    out[2] = transpose_planes_sse2(_mm_unpacklo_epi16(b01_hi, b23_hi));
+    out[3] = transpose_planes_sse2(_mm_unpackhi_epi16(b01_hi, b23_hi));
+}
+
+// 16 positions per iteration; returns where it stopped
+static size_t planar_to_indexed_sse2(const uint8_t* src, size_t plane_length,
+                                     size_t begin, uint8_t* dst) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    size_t i = begin;
+    for (; i + 16 <= plane_length; i += 16) {
+        __m128i linear[4];
+        load_linear_sse2(src, plane_length, i, linear);
+
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i * 8);
+        for (int k = 0; k < 4; k++) {
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(linear[k], 4), nibble);
+            __m128i lo = _mm_and_si128(linear[k], nibble);
+            _mm_storeu_si128(out + k * 2, _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(out + k * 2 + 1, _mm_unpackhi_epi8(hi, lo));
+        }
+    }
+    return i;
+}
+
+#endif
+
+#ifdef KERNELS_AVX2
+
+TARGET_AVX2
+static inline __m256i delta_swap_avx2(__m256i x, int delta, __m256i mask) {
+    __m256i t = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi32(x, delta), x), mask);
+    return _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi32(t, delta));
+}
+
+TARGET_AVX2
+static inline __m256i transpose_planes_avx2(__m256i x) {
+    x = delta_swap_avx2(x, 20, _mm256_set1_epi32(0x00000F0F));
+    x = delta_swap_avx2(x, 10, _mm256_set1_epi32(0x00330033));
+    x = delta_swap_avx2(x, 3, _mm256_set1_epi32(0x0A0A0A0A));
+    x = delta_swap_avx2(x, 3, _mm256_set1_epi32(0x11111111));
+    return x;
+}
+
+// Linear 4bpp bytes for positions i to i + 31, in order
+TARGET_AVX2
+static inline void load_linear_avx2(const uint8_t* src, size_t plane_length, size_t i, __m256i out[4]) {
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + plane_length + i));
+    __m256i b2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + plane_length * 2 + i));
+    __m256i b3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + plane_length * 3 + i));
+
+    // Unpacks work per 128-bit lane: w0 holds positions 0-3 and 16-19,
+    // w1 4-7 and 20-23, w2 8-11 and 24-27, w3 12-15 and 28-31
+    __m256i b01_lo = _mm256_unpacklo_epi8(b0, b1);
+    __m256i b01_hi = _mm256_unpackhi_epi8(b0, b1);
+    __m256i b23_lo = _mm256_unpacklo_epi8(b2, b3);
+    __m256i b23_hi = _mm256_unpackhi_epi8(b2, b3);
+
+    __m256i w0 = transpose_planes_avx2(_mm256_unpacklo_epi16(b01_lo, b23_lo));
+    __m256i w1 = transpose_planes_avx2(_mm256_unpackhi_epi16(b01_lo, b23_lo));
+    __m256i w2 = transpose_planes_avx2(_mm256_unpacklo_epi16(b01_hi, b23_hi));
+    __m256i w3 = transpose_planes_avx2(_mm256_unpackhi_epi16(b01_hi, b23_hi));
+
+    out[0] = _mm256_permute2x128_si256(w0, w1, 0x20);
+    out[1] = _mm256_permute2x128_si256(w2, w3, 0x20);
+    out[2] = _mm256_permute2x128_si256(w0, w1, 0x31);
+    out[3] = _mm256_permute2x128_si256(w2, w3, 0x31);
+}
+
+// 32 positions per iteration; returns where it stopped
+TARGET_AVX2
+static size_t planar_to_indexed_avx2(const uint8_t* src, size_t plane_length,
+                                     size_t begin, uint8_t* dst) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    size_t i = begin;
+    for (; i + 32 <= plane_length; i += 32) {
+        __m256i linear[4];
+        load_linear_avx2(src, plane_length, i, linear);
+
+        __m256i* out = reinterpret_cast<__m256i*>(dst + i * 8);
+        for (int k = 0; k < 4; k++) {
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(linear[k], 4), nibble);
+            __m256i lo = _mm256_and_si256(linear[k], nibble);
+            __m256i first = _mm256_unpacklo_epi8(hi, lo);
+            __m256i second = _mm256_unpackhi_epi8(hi, lo);
+            _mm256_storeu_si256(out + k * 2, _mm256_permute2x128_si256(first, second, 0x20));
+            _mm256_storeu_si256(out + k * 2 + 1, _mm256_permute2x128_si256(first, second, 0x31));
+        }
+    }
+    return i;
+}
+
+#endif
+
+// ============================================================================
+// Palette Expansion
+// ============================================================================
+
+// A 256-entry table does not fit in registers, so the vector versions
+// look entries up with AVX2 gathers, or with scalar loads assembled into
+// a vector on SSE2. Keyed variants then select between the looked-up
+// pixels and dst on a compare against zero, with no branch per pixel.
+
+static void indexed_to_argb_scalar(const uint8_t* src, size_t begin, size_t count,
+                                   const uint32_t* lut, uint32_t* dst) {
+    for (size_t i = begin; i < count; i++) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+static void indexed_to_argb_keyed_scalar(const uint8_t* src, size_t begin, size_t count,
+                                         const uint32_t* lut, uint32_t* dst) {
+    for (size_t i = begin; i < count; i++) {
+        if (src[i] != 0) dst[i] = lut[src[i]];
+    }
+}
+
+#ifdef KERNELS_SSE2
+
+static inline __m128i lookup4_sse2(const uint8_t* src, const uint32_t* lut) {
+    return _mm_set_epi32(static_cast<int>(lut[src[3]]), static_cast<int>(lut[src[2]]),
+                         static_cast<int>(lut[src[1]]), static_cast<int>(lut[src[0]]));
+}
+
+// 16 pixels per iteration; returns where it stopped
+static size_t indexed_to_argb_sse2(const uint8_t* src, size_t begin, size_t count,
+                                   const uint32_t* lut, uint32_t* dst) {
+    size_t i = begin;
+    for (; i + 16 <= count; i += 16) {
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128(out + k, lookup4_sse2(src + i + k * 4, lut));
+        }
+    }
+    return i;
+}
+
+static size_t indexed_to_argb_keyed_sse2(const uint8_t* src, size_t begin, size_t count,
+                                         const uint32_t* lut, uint32_t* dst) {
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = begin;
+    for (; i + 16 <= count; i += 16) {
+        __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i bytes = _mm_cmpeq_epi8(indices, zero);
+        if (_mm_movemask_epi8(bytes) == 0xFFFF) continue;  // Fully transparent
+
+        // Widen the per-byte mask to one 32-bit lane per pixel
+        __m128i words_lo = _mm_unpacklo_epi8(bytes, bytes);
+        __m128i words_hi = _mm_unpackhi_epi8(bytes, bytes);
+        __m128i masks[4] = {
+            _mm_unpacklo_epi16(words_lo, words_lo), _mm_unpackhi_epi16(words_lo, words_lo),
+            _mm_unpacklo_epi16(words_hi, words_hi), _mm_unpackhi_epi16(words_hi, words_hi),
+        };
+
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        for (int k = 0; k < 4; k++) {
+            __m128i colors = lookup4_sse2(src + i + k * 4, lut);
+            __m128i old = _mm_loadu_si128(out + k);
+            __m128i blended = _mm_or_si128(_mm_and_si128(masks[k], old), _mm_andnot_si128(masks[k], colors));
+            _mm_storeu_si128(out + k, blended);
+        }
+    }
+    return i;
+}
+
+#endif
+
+#ifdef KERNELS_AVX2
+
+// 16 pixels per iteration, as two gathers of 8
+TARGET_AVX2
+static size_t indexed_to_argb_avx2(const uint8_t* src, size_t begin, size_t count,
+                                   const uint32_t* lut, uint32_t* dst) {
+    const int* table = reinterpret_cast<const int*>(lut);
+
+    size_t i = begin;
+    for (; i + 16 <= count; i += 16) {
+        __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256i lo = _mm256_cvtepu8_epi32(indices);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8));
+
+        __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+        _mm256_storeu_si256(out, _mm256_i32gather_epi32(table, lo, 4));
+        _mm256_storeu_si256(out + 1, _mm256_i32gather_epi32(table, hi, 4));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t indexed_to_argb_keyed_avx2(const uint8_t* src, size_t begin, size_t count,
+                                         const uint32_t* lut, uint32_t* dst) {
+    const int* table = reinterpret_cast<const int*>(lut);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = begin;
+    for (; i + 16 <= count; i += 16) {
+        __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(indices, _mm_setzero_si128())) == 0xFFFF) continue;
+
+        __m256i idx[2] = {_mm256_cvtepu8_epi32(indices), _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8))};
+        __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+        for (int k = 0; k < 2; k++) {
+            __m256i colors = _mm256_i32gather_epi32(table, idx[k], 4);
+            __m256i transparent = _mm256_cmpeq_epi32(idx[k], zero);
+            __m256i old = _mm256_loadu_si256(out + k);
+            _mm256_storeu_si256(out + k, _mm256_blendv_epi8(colors, old, transparent));
+        }
+    }
+    return i;
+}
+
+#endif
+
+static Isa clamp_isa(Isa isa) {
+    Isa best = detect_isa();
+    return static_cast<int>(isa) > static_cast<int>(best) ? best : isa;
+}
+
+// Wider kernels leave their tail to the narrower ones
+// Wider kernels leave their tail to the narrower ones
+void planar_to_indexed(const uint8_t* src, size_t size, uint8_t* dst, Isa isa) {
+    size_t plane_length = size / 4;
+    size_t done = 0;
+    isa = clamp_isa(isa);
+
+#ifdef KERNELS_AVX2
+    if (isa == Isa::Avx2) {
+        done = planar_to_indexed_avx2(src, plane_length, done, dst);
+    }
+#endif
+#ifdef KERNELS_SSE2
+    if (isa != Isa::Scalar) {
+        done = planar_to_indexed_sse2(src, plane_length, done, dst);
+    }
+#endif
+
+    planar_to_indexed_scalar(src, plane_length, done, dst);
+}
+
+void planar_to_indexed(const uint8_t* src, size_t size, uint8_t* dst) {
+    planar_to_indexed(src, size, dst, detect_isa());
+}
+
+void indexed_to_argb(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst, Isa isa) {
+    size_t done = 0;
+    isa = clamp_isa(isa);
+
+#ifdef KERNELS_AVX2
+    if (isa == Isa::Avx2) {
+        done = indexed_to_argb_avx2(src, done, count, lut, dst);
+    }
+#endif
+#ifdef KERNELS_SSE2
+    if (isa != Isa::Scalar) {
+        done = indexed_to_argb_sse2(src, done, count, lut, dst);
+    }
+#endif
+
+    indexed_to_argb_scalar(src, done, count, lut, dst);
+}
+
+void indexed_to_argb(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst) {
+    indexed_to_argb(src, count, lut, dst, detect_isa());
+}
+
+void indexed_to_argb_keyed(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst, Isa isa) {
+    size_t done = 0;
+    isa = clamp_isa(isa);
+
+#ifdef KERNELS_AVX2
+    if (isa == Isa::Avx2) {
+        done = indexed_to_argb_keyed_avx2(src, done, count, lut, dst);
+    }
+#endif
+#ifdef KERNELS_SSE2
+    if (isa != Isa::Scalar) {
+        done = indexed_to_argb_keyed_sse2(src, done, count, lut, dst);
+    }
+#endif
+
+    indexed_to_argb_keyed_scalar(src, done, count, lut, dst);
+}
+
+void indexed_to_argb_keyed(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst) {
+    indexed_to_argb_keyed(src, count, lut, dst, detect_isa());
+}
+
+} // namespace kernels
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace kernels {
+
+// Instruction sets the kernels are built for
+enum class Isa {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// Best instruction set supported by this CPU (detected once)
+Isa detect_isa();
+const char* isa_name(Isa isa);
+
+// De-interleave four VGA bit planes into 8bpp palette indices, one byte
+// per pixel. src holds size / 4 bytes per plane, one plane after another;
+// size must be a multiple of 4, dst receives size * 2 bytes and must not
+// overlap src.
+void planar_to_indexed(const uint8_t* src, size_t size, uint8_t* dst);
+
+// Fixed-ISA variants, for testing and benchmarks. Requesting an ISA the
+// CPU does not support falls back to the best one it does.
+void planar_to_indexed(const uint8_t* src, size_t size, uint8_t* dst, Isa isa);
+
+// Expand count 8bpp palette indices to 32-bit pixels through a 256-entry
+// table (lut[index] is the output pixel)
+void indexed_to_argb(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst);
+void indexed_to_argb(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst, Isa isa);
+
+// Same, but index 0 is transparent: those pixels of dst are left as they
+// are. Used to draw tiles over what is already there.
+void indexed_to_argb_keyed(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst);
+void indexed_to_argb_keyed(const uint8_t* src, size_t count, const uint32_t* lut, uint32_t* dst, Isa isa);
+
+} // namespace kernels
@@ -0,0 +1,673 @@
+#include "png_writer.h"
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <stdexcept>
+
+namespace png {
+
+// ============================================================================
+// Deflate Tables
+// ============================================================================
+
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+static const size_t WINDOW_SIZE = 32768;
+static const size_t MAX_STORED = 65535;
+static const size_t BLOCK_TOKENS = 16384;
+
+static const int NUM_LITLEN = 288;
+static const int NUM_DIST = 30;
+static const int NUM_CODELEN = 19;
+static const int END_OF_BLOCK = 256;
+
+static const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t CODELEN_ORDER[NUM_CODELEN] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Symbol lookups for match lengths and distances
+struct SymbolTables {
+    uint8_t length_code[MAX_MATCH + 1];  // Index into LENGTH_BASE
+    uint8_t dist_code[512];              // d-1 < 256: [d-1]; else [256 + ((d-1) >> 7)]
+
+    SymbolTables() {
+        for (int code = 0; code < 29; code++) {
+            int end = code + 1 < 29 ? LENGTH_BASE[code + 1] : MAX_MATCH + 1;
+            for (int len = LENGTH_BASE[code]; len < end; len++) {
+                length_code[len] = static_cast<uint8_t>(code);
+            }
+        }
+        length_code[MAX_MATCH] = 28;
+
+        for (int code = 0; code < NUM_DIST; code++) {
+            int end = code + 1 < NUM_DIST ? DIST_BASE[code + 1] : 32769;
+            for (int d = DIST_BASE[code]; d < end; d++) {
+                if (d - 1 < 256) {
+                    dist_code[d - 1] = static_cast<uint8_t>(code);
+                } else {
+                    dist_code[256 + ((d - 1) >> 7)] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+    }
+
+    int dist(int d) const {
+        return d - 1 < 256 ? dist_code[d - 1] : dist_code[256 + ((d - 1) >> 7)];
+    }
+};
+
+static const SymbolTables SYMBOLS;
+
+// Match search effort per level
+struct LevelParams {
+    int max_chain;    // Candidates examined per position
+    int nice_length;  // Stop searching at this length
+    bool lazy;        // Try a longer match at the next byte first
+};
+
+static const LevelParams LEVEL_PARAMS[10] = {
+    {0, 0, false},
+    {4, 16, false},
+    {8, 32, false},
+    {16, 64, false},
+    {16, 64, true},
+    {32, 128, true},
+    {128, 128, true},
+    {256, MAX_MATCH, true},
+    {1024, MAX_MATCH, true},
+    {4096, MAX_MATCH, true},
+};
+
+// ============================================================================
+// Bit Output
+// ============================================================================
+
+// Deflate packs bits LSB first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void put(uint32_t value, int count) {
+        bits |= static_cast<uint64_t>(value) << bit_count;
+        bit_count += count;
+        while (bit_count >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void align() {
+        if (bit_count > 0) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits = 0;
+            bit_count = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int bit_count = 0;
+};
+
+// ============================================================================
+// Huffman Codes
+// ============================================================================
+
+// Length-limited code lengths: plain Huffman depths, then lengths over
+// max_bits are folded back and the Kraft sum repaired by lengthening the
+// deepest codes that still fit, as zlib and miniz do
+static std::vector<uint8_t> build_lengths(const std::vector<uint32_t>& freq, int max_bits) {
+    std::vector<uint8_t> lengths(freq.size(), 0);
+    std::vector<int> used;
+    for (size_t i = 0; i < freq.size(); i++) {
+        if (freq[i] > 0) used.push_back(static_cast<int>(i));
+    }
+
+    if (used.empty()) return lengths;
+    if (used.size() == 1) {
+        // A lone symbol still needs a complete code: pair it with a dummy
+        lengths[used[0]] = 1;
+        lengths[used[0] == 0 ? 1 : 0] = 1;
+        return lengths;
+    }
+
+    // Huffman tree over the used symbols; nodes >= used.size() are internal
+    struct Node {
+        uint64_t weight;
+        int index;
+        bool operator>(const Node& other) const {
+            return weight != other.weight ? weight > other.weight : index > other.index;
+        }
+    };
+    std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+    std::vector<int> parent(used.size() * 2, -1);
+    for (size_t i = 0; i < used.size(); i++) {
+        queue.push(Node{freq[used[i]], static_cast<int>(i)});
+    }
+    int next = static_cast<int>(used.size());
+    while (queue.size() > 1) {
+        Node a = queue.top(); queue.pop();
+        Node b = queue.top(); queue.pop();
+        parent[a.index] = next;
+        parent[b.index] = next;
+        queue.push(Node{a.weight + b.weight, next});
+        next++;
+    }
+
+    // Count codes per depth, clamping to max_bits
+    std::vector<int> count(max_bits + 1, 0);
+    for (size_t i = 0; i < used.size(); i++) {
+        int depth = 0;
+        for (int node = static_cast<int>(i); parent[node] >= 0; node = parent[node]) depth++;
+        count[std::min(depth, max_bits)]++;
+    }
+
+    uint32_t total = 0;
+    for (int len = max_bits; len > 0; len--) {
+        total += static_cast<uint32_t>(count[len]) << (max_bits - len);
+    }
+    while (total != (1u << max_bits)) {
+        count[max_bits]--;
+        for (int len = max_bits - 1; len > 0; len--) {
+            if (count[len]) {
+                count[len]--;
+                count[len + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // Most frequent symbols get the shortest codes
+    std::stable_sort(used.begin(), used.end(), [&](int a, int b) { return freq[a] > freq[b]; });
+    size_t pos = 0;
+    for (int len = 1; len <= max_bits; len++) {
+        for (int n = 0; n < count[len]; n++) {
+            lengths[used[pos++]] = static_cast<uint8_t>(len);
+        }
+    }
+    return lengths;
+}
+
+// Canonical codes, bit-reversed for LSB-first output
+static std::vector<uint16_t> build_codes(const std::vector<uint8_t>& lengths) {
+    int bl_count[16] = {0};
+    for (uint8_t len : lengths) bl_count[len]++;
+    bl_count[0] = 0;
+
+    uint16_t next_code[16] = {0};
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = static_cast<uint16_t>((code + bl_count[bits - 1]) << 1);
+        next_code[bits] = code;
+    }
+
+    std::vector<uint16_t> codes(lengths.size(), 0);
+    for (size_t i = 0; i < lengths.size(); i++) {
+        int len = lengths[i];
+        if (len == 0) continue;
+        uint16_t value = next_code[len]++;
+        uint16_t reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed = static_cast<uint16_t>((reversed << 1) | ((value >> b) & 1));
+        }
+        codes[i] = reversed;
+    }
+    return codes;
+}
+
+// ============================================================================
+// Block Encoding
+// ============================================================================
+
+// A literal (dist == 0) or a back-reference
+struct Token {
+    uint16_t value;  // Literal byte or match length
+    uint16_t dist;
+};
+
+struct CodeLengthRun {
+    uint8_t symbol;  // 0-15 literal length, 16/17/18 repeat
+    uint8_t extra;   // Repeat count minus the symbol's minimum
+};
+
+// Run-length code the concatenated literal/length and distance lengths
+static std::vector<CodeLengthRun> encode_code_lengths(const std::vector<uint8_t>& lengths) {
+    std::vector<CodeLengthRun> runs;
+    size_t i = 0;
+    while (i < lengths.size()) {
+        uint8_t len = lengths[i];
+        size_t run = 1;
+        while (i + run < lengths.size() && lengths[i + run] == len) run++;
+
+        if (len == 0 && run >= 3) {
+            size_t n = std::min<size_t>(run, 138);
+            if (n >= 11) {
+                runs.push_back({18, static_cast<uint8_t>(n - 11)});
+            } else {
+                runs.push_back({17, static_cast<uint8_t>(n - 3)});
+            }
+            i += n;
+        } else if (len != 0 && run >= 4) {
+            runs.push_back({len, 0});
+            size_t n = std::min<size_t>(run - 1, 6);
+            runs.push_back({16, static_cast<uint8_t>(n - 3)});
+            i += 1 + n;
+        } else {
+            runs.push_back({len, 0});
+            i++;
+        }
+    }
+    return runs;
+}
+
+static const int CODELEN_EXTRA_BITS[NUM_CODELEN] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7
+};
+
+class BlockEncoder {
+public:
+    explicit BlockEncoder(BitWriter& out) : out(out) {}
+
+    // Emit tokens covering data[begin, end) as the cheapest block type
+    void write(const std::vector<Token>& tokens, const uint8_t* data, size_t begin, size_t end,
+               bool final) {
+        std::vector<uint32_t> litlen_freq(NUM_LITLEN, 0);
+        std::vector<uint32_t> dist_freq(NUM_DIST, 0);
+        for (const Token& token : tokens) {
+            if (token.dist == 0) {
+                litlen_freq[token.value]++;
+            } else {
+                litlen_freq[257 + SYMBOLS.length_code[token.value]]++;
+                dist_freq[SYMBOLS.dist(token.dist)]++;
+            }
+        }
+        litlen_freq[END_OF_BLOCK] = 1;
+
+        // Dynamic codes. Keep at least one distance code so every decoder
+        // sees a valid tree.
+        std::vector<uint32_t> dist_freq_used = dist_freq;
+        if (std::all_of(dist_freq_used.begin(), dist_freq_used.end(), [](uint32_t f) { return f == 0; })) {
+            dist_freq_used[0] = 1;
+        }
+        std::vector<uint8_t> litlen_lengths = build_lengths(litlen_freq, 15);
+        std::vector<uint8_t> dist_lengths = build_lengths(dist_freq_used, 15);
+
+        int hlit = 286;
+        while (hlit > 257 && litlen_lengths[hlit - 1] == 0) hlit--;
+        int hdist = NUM_DIST;
+        while (hdist > 1 && dist_lengths[hdist - 1] == 0) hdist--;
+
+        std::vector<uint8_t> all_lengths(litlen_lengths.begin(), litlen_lengths.begin() + hlit);
+        all_lengths.insert(all_lengths.end(), dist_lengths.begin(), dist_lengths.begin() + hdist);
+        std::vector<CodeLengthRun> runs = encode_code_lengths(all_lengths);
+
+        std::vector<uint32_t> codelen_freq(NUM_CODELEN, 0);
+        for (const auto& run : runs) codelen_freq[run.symbol]++;
+        std::vector<uint8_t> codelen_lengths = build_lengths(codelen_freq, 7);
+        int hclen = NUM_CODELEN;
+        while (hclen > 4 && codelen_lengths[CODELEN_ORDER[hclen - 1]] == 0) hclen--;
+
+        uint64_t dynamic_bits = 5 + 5 + 4 + 3 * hclen;
+        for (const auto& run : runs) {
+            dynamic_bits += codelen_lengths[run.symbol] + CODELEN_EXTRA_BITS[run.symbol];
+        }
+        dynamic_bits += data_bits(litlen_freq, dist_freq, litlen_lengths, dist_lengths);
+
+        uint64_t fixed_bits = data_bits(litlen_freq, dist_freq, fixed_litlen_lengths(), fixed_dist_lengths());
+
+        size_t raw = end - begin;
+        uint64_t stored_blocks = raw == 0 ? 1 : (raw + MAX_STORED - 1) / MAX_STORED;
+        uint64_t stored_bits = raw * 8 + stored_blocks * (32 + 3 + 7);
+
+        if (stored_bits <= fixed_bits && stored_bits <= dynamic_bits) {
+            write_stored(data, begin, end, final);
+        } else if (fixed_bits <= dynamic_bits) {
+            out.put(final ? 1 : 0, 1);
+            out.put(1, 2);
+            write_tokens(tokens, fixed_litlen_lengths(), fixed_dist_lengths());
+        } else {
+            out.put(final ? 1 : 0, 1);
+            out.put(2, 2);
+            out.put(hlit - 257, 5);
+            out.put(hdist - 1, 5);
+            out.put(hclen - 4, 4);
+            for (int i = 0; i < hclen; i++) {
+                out.put(codelen_lengths[CODELEN_ORDER[i]], 3);
+            }
+            std::vector<uint16_t> codelen_codes = build_codes(codelen_lengths);
+            for (const auto& run : runs) {
+                out.put(codelen_codes[run.symbol], codelen_lengths[run.symbol]);
+                if (CODELEN_EXTRA_BITS[run.symbol]) {
+                    out.put(run.extra, CODELEN_EXTRA_BITS[run.symbol]);
+                }
+            }
+            write_tokens(tokens, litlen_lengths, dist_lengths);
+        }
+    }
+
+    void write_stored(const uint8_t* data, size_t begin, size_t end, bool final) {
+        do {
+            size_t n = std::min(end - begin, MAX_STORED);
+            bool last = final && begin + n == end;
+            out.put(last ? 1 : 0, 1);
+            out.put(0, 2);
+            out.align();
+            out.put(static_cast<uint32_t>(n), 16);
+            out.put(static_cast<uint32_t>(~n & 0xFFFF), 16);
+            for (size_t i = 0; i < n; i++) out.put(data[begin + i], 8);
+            begin += n;
+        } while (begin < end);
+    }
+
+private:
+    BitWriter& out;
+
+    static const std::vector<uint8_t>& fixed_litlen_lengths() {
+        static const std::vector<uint8_t> lengths = []() {
+            std::vector<uint8_t> l(NUM_LITLEN);
+            for (int i = 0; i < NUM_LITLEN; i++) {
+                l[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            }
+            return l;
+        }();
+        return lengths;
+    }
+
+    static const std::vector<uint8_t>& fixed_dist_lengths() {
+        static const std::vector<uint8_t> lengths(NUM_DIST, 5);
+        return lengths;
+    }
+
+    static uint64_t data_bits(const std::vector<uint32_t>& litlen_freq, const std::vector<uint32_t>& dist_freq,
+                              const std::vector<uint8_t>& litlen_lengths,
+                              const std::vector<uint8_t>& dist_lengths) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 286; i++) {
+            bits += static_cast<uint64_t>(litlen_freq[i]) *
+                    (litlen_lengths[i] + (i > 256 ? LENGTH_EXTRA[i - 257] : 0));
+        }
+        for (int i = 0; i < NUM_DIST; i++) {
+            bits += static_cast<uint64_t>(dist_freq[i]) * (dist_lengths[i] + DIST_EXTRA[i]);
+        }
+        return bits;
+    }
+
+    void write_tokens(const std::vector<Token>& tokens, const std::vector<uint8_t>& litlen_lengths,
+                      const std::vector<uint8_t>& dist_lengths) {
+        std::vector<uint16_t> litlen_codes = build_codes(litlen_lengths);
+        std::vector<uint16_t> dist_codes = build_codes(dist_lengths);
+
+        for (const Token& token : tokens) {
+            if (token.dist == 0) {
+                out.put(litlen_codes[token.value], litlen_lengths[token.value]);
+                continue;
+            }
+            int len_code = SYMBOLS.length_code[token.value];
+            out.put(litlen_codes[257 + len_code], litlen_lengths[257 + len_code]);
+            if (LENGTH_EXTRA[len_code]) {
+                out.put(token.value - LENGTH_BASE[len_code], LENGTH_EXTRA[len_code]);
+            }
+            int dist_code = SYMBOLS.dist(token.dist);
+            out.put(dist_codes[dist_code], dist_lengths[dist_code]);
+            if (DIST_EXTRA[dist_code]) {
+                out.put(token.dist - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+            }
+        }
+        out.put(litlen_codes[END_OF_BLOCK], litlen_lengths[END_OF_BLOCK]);
+    }
+};
+
+// ============================================================================
+// Match Finder
+// ============================================================================
+
+// Hash chains over a 32 KiB window
+class MatchFinder {
+public:
+    MatchFinder(const uint8_t* data, size_t size, const LevelParams& params)
+        : data(data), size(size), params(params), head(HASH_SIZE, NONE), prev(WINDOW_SIZE, NONE) {}
+
+    // Longest match for pos against earlier data; length 0 if none
+    int find(size_t pos, int& dist) {
+        insert_until(pos);
+        if (pos + MIN_MATCH > size) return 0;
+
+        int max_len = static_cast<int>(std::min<size_t>(MAX_MATCH, size - pos));
+        int best = 0;
+        size_t candidate = head[hash(pos)];
+        for (int chain = params.max_chain; chain > 0 && candidate != NONE; chain--) {
+            if (pos - candidate > WINDOW_SIZE) break;
+
+            if (data[candidate + best] == data[pos + best]) {
+                int len = 0;
+                while (len < max_len && data[candidate + len] == data[pos + len]) len++;
+                if (len > best) {
+                    best = len;
+                    dist = static_cast<int>(pos - candidate);
+                    if (len >= params.nice_length || len == max_len) break;
+                }
+            }
+            size_t older = prev[candidate & (WINDOW_SIZE - 1)];
+            if (older == NONE || older >= candidate) break;
+            candidate = older;
+        }
+        return best >= MIN_MATCH ? best : 0;
+    }
+
+private:
+    static const size_t HASH_BITS = 15;
+    static const size_t HASH_SIZE = size_t(1) << HASH_BITS;
+    static constexpr size_t NONE = ~size_t(0);
+
+    const uint8_t* data;
+    size_t size;
+    const LevelParams& params;
+    std::vector<size_t> head;
+    std::vector<size_t> prev;
+    size_t inserted = 0;
+
+    size_t hash(size_t pos) const {
+        uint32_t v = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Chain every position before pos
+    void insert_until(size_t pos) {
+        for (; inserted < pos && inserted + MIN_MATCH <= size; inserted++) {
+            size_t h = hash(inserted);
+            prev[inserted & (WINDOW_SIZE - 1)] = head[h];
+            head[h] = inserted;
+        }
+        if (inserted < pos) inserted = pos;
+    }
+};
+
+// ============================================================================
+// zlib / PNG
+// ============================================================================
+
+static uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t n = std::min<size_t>(size, 5552);  // Largest n with no uint32 overflow
+        size -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t size, int level) {
+    level = std::max(STORE_LEVEL, std::min(level, BEST_LEVEL));
+
+    std::vector<uint8_t> out;
+    out.reserve(size / 2 + 64);
+
+    // CMF: deflate with a 32 KiB window; FLG: level hint and check bits
+    uint8_t flevel = level == 0 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    uint8_t cmf = 0x78;
+    uint8_t flg = static_cast<uint8_t>(flevel << 6);
+    flg = static_cast<uint8_t>(flg + (31 - (cmf * 256 + flg) % 31) % 31);
+    out.push_back(cmf);
+    out.push_back(flg);
+
+    BitWriter bits(out);
+    BlockEncoder encoder(bits);
+
+    if (level == STORE_LEVEL) {
+        encoder.write_stored(data, 0, size, true);
+    } else {
+        const LevelParams& params = LEVEL_PARAMS[level];
+        MatchFinder finder(data, size, params);
+        std::vector<Token> tokens;
+        tokens.reserve(BLOCK_TOKENS);
+        size_t block_begin = 0;
+        size_t pos = 0;
+
+        while (pos < size) {
+            int dist = 0;
+            int len = finder.find(pos, dist);
+
+            // Lazy evaluation: prefer a literal if the next byte starts a
+            // longer match
+            if (len > 0 && params.lazy && len < params.nice_length && pos + 1 < size) {
+                int next_dist = 0;
+                int next_len = finder.find(pos + 1, next_dist);
+                if (next_len > len) {
+                    tokens.push_back(Token{data[pos], 0});
+                    pos++;
+                    len = next_len;
+                    dist = next_dist;
+                }
+            }
+
+            if (len > 0) {
+                tokens.push_back(Token{static_cast<uint16_t>(len), static_cast<uint16_t>(dist)});
+                pos += len;
+            } else {
+                tokens.push_back(Token{data[pos], 0});
+                pos++;
+            }
+
+            if (tokens.size() >= BLOCK_TOKENS && pos < size) {
+                encoder.write(tokens, data, block_begin, pos, false);
+                tokens.clear();
+                block_begin = pos;
+            }
+        }
+        encoder.write(tokens, data, block_begin, size, true);
+    }
+    bits.align();
+
+    uint32_t check = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(check >> shift));
+    }
+    return out;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_u32_be(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static void put_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    put_u32_be(out, static_cast<uint32_t>(size));
+    size_t type_pos = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    put_u32_be(out, crc32(&out[type_pos], size + 4));
+}
+
+std::vector<uint8_t> encode_indexed(const uint8_t* pixels, int width, int height,
+                                    const uint8_t* palette_rgb, int palette_size, int level) {
+    if (width <= 0 || height <= 0) {
+        throw std::runtime_error("PNG image must not be empty");
+    }
+
+    size_t count = static_cast<size_t>(width) * height;
+    int max_index = count ? *std::max_element(pixels, pixels + count) : 0;
+    int depth = max_index < 2 ? 1 : max_index < 4 ? 2 : max_index < 16 ? 4 : 8;
+
+    // Scanlines, each with filter type 0 (indexed images rarely gain from
+    // the others), pixels packed MSB first
+    size_t row_bytes = (static_cast<size_t>(width) * depth + 7) / 8;
+    std::vector<uint8_t> raw((row_bytes + 1) * height, 0);
+    int per_byte = 8 / depth;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = &raw[y * (row_bytes + 1) + 1];
+        const uint8_t* src = pixels + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; x++) {
+            int shift = 8 - depth * (x % per_byte + 1);
+            row[x / per_byte] |= static_cast<uint8_t>(src[x] << shift);
+        }
+    }
+    std::vector<uint8_t> idat = zlib_compress(raw.data(), raw.size(), level);
+
+    std::vector<uint8_t> out;
+    out.reserve(idat.size() + 3 * (max_index + 1) + 64);
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.insert(out.end(), SIGNATURE, SIGNATURE + 8);
+
+    std::vector<uint8_t> ihdr;
+    put_u32_be(ihdr, static_cast<uint32_t>(width));
+    put_u32_be(ihdr, static_cast<uint32_t>(height));
+    ihdr.push_back(static_cast<uint8_t>(depth));
+    ihdr.push_back(3);  // Indexed color
+    ihdr.push_back(0);  // Deflate
+    ihdr.push_back(0);  // Adaptive filtering
+    ihdr.push_back(0);  // No interlace
+    put_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    std::vector<uint8_t> plte(3 * (max_index + 1), 0);
+    std::copy(palette_rgb, palette_rgb + 3 * std::min(max_index + 1, palette_size), plte.begin());
+    put_chunk(out, "PLTE", plte.data(), plte.size());
+
+    put_chunk(out, "IDAT", idat.data(), idat.size());
+    put_chunk(out, "IEND", nullptr, 0);
+    return out;
+}
+
+} // namespace png
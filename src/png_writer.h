@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace png {
+
+// Compression levels: 0 stores, 1 is fastest, 9 is smallest
+constexpr int STORE_LEVEL = 0;
+constexpr int FAST_LEVEL = 1;
+constexpr int DEFAULT_LEVEL = 6;
+constexpr int BEST_LEVEL = 9;
+
+// zlib stream (RFC 1950) around a deflate stream (RFC 1951). Each block is
+// emitted stored, with fixed codes or with dynamic codes, whichever is
+// smallest; higher levels search longer for matches.
+std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t size, int level = DEFAULT_LEVEL);
+
+// CRC-32 as used by PNG chunks and gzip
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+// Indexed-color PNG of 8bpp pixels. palette_rgb holds palette_size RGB
+// triplets. The bit depth is the smallest (1, 2, 4 or 8) that fits the
+// highest index used, and the palette is trimmed to match.
+std::vector<uint8_t> encode_indexed(const uint8_t* pixels, int width, int height,
+                                    const uint8_t* palette_rgb, int palette_size,
+                                    int level = DEFAULT_LEVEL);
+
+} // namespace png
@@ -1,4 +1,6 @@
 #include "renderer.h"
+#include "pixel_kernels.h"
+#include <algorithm>
 #include <stdexcept>
 
 namespace renderer {
@@ -48,9 +50,11 @@ bool Renderer::init(const char* title) {
 }
 
 void Renderer::shutdown() {
-    if (tilemap_texture) {
-        SDL_DestroyTexture(tilemap_texture);
-        tilemap_texture = nullptr;
+    destroy_chunks();
+    destroy_atlas();
+    if (frame_texture) {
+        SDL_DestroyTexture(frame_texture);
+        frame_texture = nullptr;
     }
     if (background_texture) {
         SDL_DestroyTexture(background_texture);
@@ -67,7 +71,17 @@ void Renderer::shutdown() {
     SDL_Quit();
 }
 
-SDL_Texture* Renderer::create_texture_from_image(const assets::Image& image) {
+// ARGB pixel for every palette index, scaled by fade (256 = unchanged)
+static void build_palette_lut(const assets::Palette& palette, int fade, uint32_t* lut) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t r = palette.r(i) * fade >> 8;
+        uint32_t g = palette.g(i) * fade >> 8;
+        uint32_t b = palette.b(i) * fade >> 8;
+        lut[i] = (0xFFu << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+SDL_Texture* Renderer::create_texture_from_image(const assets::Image& image, const assets::Palette& image_palette) {
     SDL_Surface* surface = SDL_CreateRGBSurface(
         0, image.width, image.height, 32,
         0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000
@@ -77,19 +91,18 @@ SDL_Texture* Renderer::create_texture_from_image(const assets::Image& image) {
         return nullptr;
     }
     
-    uint32_t* pixels = static_cast<uint32_t*>(surface->pixels);
+    uint32_t lut[256];
+    build_palette_lut(image_palette, 256, lut);
     
+    // Rows past the end of a short image use palette entry 0
     for (int y = 0; y < image.height; y++) {
-        for (int x = 0; x < image.width; x++) {
-            int idx = y * image.width + x;
-            uint8_t color_idx = (idx < static_cast<int>(image.pixels.size())) ? image.pixels[idx] : 0;
-            
-            uint8_t r = image.palette.r(color_idx);
-            uint8_t g = image.palette.g(color_idx);
-            uint8_t b = image.palette.b(color_idx);
-            
-            pixels[idx] = (0xFF << 24) | (r << 16) | (g << 8) | b;
-        }
+        uint32_t* dst_row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(surface->pixels) + y * surface->pitch);
+        size_t row_start = static_cast<size_t>(y) * image.width;
+        size_t available = row_start < image.pixels.size() ? image.pixels.size() - row_start : 0;
+        size_t count = std::min(available, static_cast<size_t>(image.width));
+        
+        kernels::indexed_to_argb(image.pixels.data() + row_start, count, lut, dst_row);
+        std::fill(dst_row + count, dst_row + image.width, lut[0]);
     }
     
     SDL_Texture* texture = SDL_CreateTextureFromSurface(sdl_renderer, surface);
@@ -98,107 +111,330 @@ SDL_Texture* Renderer::create_texture_from_image(const assets::Image& image) {
     return texture;
 }
 
+// Nearest-neighbour scale of an image's indices to the screen, as
+// SDL_RenderCopy does for the background texture
+static void scale_to_screen(const assets::Image& image, std::vector<uint8_t>& out, int width, int height) {
+    out.assign(static_cast<size_t>(width) * height, 0);
+    if (image.width <= 0 || image.height <= 0) return;
+    
+    for (int y = 0; y < height; y++) {
+        size_t src_row = static_cast<size_t>(y * image.height / height) * image.width;
+        for (int x = 0; x < width; x++) {
+            size_t idx = src_row + x * image.width / width;
+            out[y * width + x] = idx < image.pixels.size() ? image.pixels[idx] : 0;
+        }
+    }
+}
+
 void Renderer::set_background(const assets::Image& image) {
+    set_background(std::make_shared<const assets::Image>(image), image.palette);
+}
+
+void Renderer::set_background(std::shared_ptr<const assets::Image> image, const assets::Palette& image_palette) {
     if (background_texture) {
         SDL_DestroyTexture(background_texture);
+        background_texture = nullptr;
     }
-    background_texture = create_texture_from_image(image);
+    background_image = std::move(image);
+    background_palette = image_palette;
+    
+    if (indexed) {
+        scale_to_screen(*background_image, background_indices, SCREEN_WIDTH, SCREEN_HEIGHT);
+    } else {
+        background_texture = create_texture_from_image(*background_image, image_palette);
+    }
+    select_palette();
 }
 
-void Renderer::clear_tilemap() {
-    if (tilemap_texture) {
-        SDL_DestroyTexture(tilemap_texture);
-        tilemap_texture = nullptr;
+void Renderer::set_indexed(bool enabled) {
+    if (enabled == indexed) return;
+    indexed = enabled;
+    
+    if (indexed) {
+        // The ARGB background is not needed until indexed mode is left
+        if (background_texture) {
+            SDL_DestroyTexture(background_texture);
+            background_texture = nullptr;
+        }
+        if (background_image) {
+            scale_to_screen(*background_image, background_indices, SCREEN_WIDTH, SCREEN_HEIGHT);
+        }
+        framebuffer.assign(SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+        select_palette();
+    } else {
+        if (frame_texture) {
+            SDL_DestroyTexture(frame_texture);
+            frame_texture = nullptr;
+        }
+        framebuffer.clear();
+        background_indices.clear();
+        if (background_image && !background_image->pixels.empty()) {
+            background_texture = create_texture_from_image(*background_image, background_palette);
+        }
     }
+}
+
+void Renderer::set_palette(const assets::Palette& new_palette) {
+    palette = new_palette;
+    update_palette_lut();
+}
+
+void Renderer::set_fade(int level) {
+    fade = std::max(0, std::min(level, 256));
+    update_palette_lut();
+}
+
+void Renderer::update_palette_lut() {
+    build_palette_lut(palette, fade, palette_lut);
+}
+
+// Indexed tiles are only correct with the level palette, so it wins while a
+// tilemap is shown; direct rendering draws tiles through tile_lut and keeps
+// the background palette
+void Renderer::select_palette() {
+    set_palette(indexed && current_level ? level_palette : background_palette);
+}
+
+void Renderer::clear_tilemap() {
+    destroy_chunks();
+    destroy_atlas();
     current_level = nullptr;
+    union_tiles = nullptr;
     scroll_x = scroll_y = 0;
     max_scroll_x = max_scroll_y = 0;
+    select_palette();
+}
+
+void Renderer::set_chunk_budget(size_t bytes) {
+    chunk_budget = bytes;
+    evict_chunks();
 }
 
-void Renderer::set_tilemap(const assets::LevelData& level) {
-    current_level = &level;
+void Renderer::set_tilemap_mode(TilemapMode mode) {
+    if (mode == tilemap_mode) return;
+    tilemap_mode = mode;
     
-    int map_width = level.tilemap.width * 16;
-    int map_height = level.tilemap.height * 16;
+    // Free the other mode's textures; the new ones are built on demand
+    if (mode == TilemapMode::Atlas) {
+        for (auto& chunk : chunks) {
+            if (chunk.texture) {
+                SDL_DestroyTexture(chunk.texture);
+                chunk = TileChunk();
+            }
+        }
+        chunk_bytes = 0;
+    } else {
+        destroy_atlas();
+    }
+}
+
+void Renderer::set_tilemap(std::shared_ptr<const assets::LevelData> level,
+                           std::shared_ptr<const assets::Tileset> level_union_tiles,
+                           const assets::Palette& new_level_palette) {
+    destroy_chunks();
+    destroy_atlas();
+    current_level = std::move(level);
+    union_tiles = std::move(level_union_tiles);
+    level_palette = new_level_palette;
+    build_palette_lut(level_palette, 256, tile_lut);
+    select_palette();
+    
+    int map_width = current_level->tilemap.width * 16;
+    int map_height = current_level->tilemap.height * 16;
     
     max_scroll_x = map_width - SCREEN_WIDTH;
     max_scroll_y = map_height - SCREEN_HEIGHT;
     if (max_scroll_x < 0) max_scroll_x = 0;
     if (max_scroll_y < 0) max_scroll_y = 0;
     
-    SDL_Surface* surface = SDL_CreateRGBSurface(
-        0, map_width, map_height, 32,
-        0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000
-    );
-    
-    if (!surface) {
-        return;
+    // Chunks are only allocated here; render_tilemap() builds them on demand
+    chunks_x = (map_width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunks_y = (map_height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunks.assign(chunks_x * chunks_y, TileChunk());
+}
+
+void Renderer::destroy_chunks() {
+    for (auto& chunk : chunks) {
+        if (chunk.texture) {
+            SDL_DestroyTexture(chunk.texture);
+        }
     }
+    chunks.clear();
+    chunks_x = chunks_y = 0;
+    chunk_bytes = 0;
+}
+
+// Pixels of the tile a LUT value refers to, or nullptr for none. Values
+// below 256 are local tiles, the rest union tiles.
+const uint8_t* Renderer::find_tile(uint16_t lut_value) const {
+    const assets::LevelData& level = *current_level;
+    const assets::Tileset& union_tileset = *union_tiles;
     
-    // Clear with transparent
-    SDL_FillRect(surface, nullptr, 0x00000000);
-    
-    uint32_t* pixels = static_cast<uint32_t*>(surface->pixels);
-    
-    auto union_tileset = assets::get_union_tiles();
+    if (lut_value < 256) {
+        if (lut_value < level.local_tiles.num_tiles) {
+            return level.local_tiles.tile(lut_value);
+        }
+    } else if (lut_value < 256 + union_tileset.num_tiles) {
+        return union_tileset.tile(lut_value - 256);
+    }
+    return nullptr;
+}
+
+// Expand one 16x16 tile into ARGB pixels (pitch in pixels), leaving
+// index 0 transparent
+void Renderer::draw_tile(const uint8_t* tile_pixels, uint32_t* dst, int pitch) const {
+    for (int py = 0; py < 16; py++) {
+        kernels::indexed_to_argb_keyed(tile_pixels + py * 16, 16, tile_lut, dst + py * pitch);
+    }
+}
+
+// Composite a block of tiles into ARGB pixels (pitch in pixels)
+void Renderer::draw_tiles(uint32_t* pixels, int pitch, int tile_x, int tile_y, int tiles_w, int tiles_h) const {
+    const assets::Tilemap& tilemap = current_level->tilemap;
     
-    for (int ty = 0; ty < level.tilemap.height; ty++) {
-        for (int tx = 0; tx < level.tilemap.width; tx++) {
-            int map_idx = ty * level.tilemap.width + tx;
-            uint8_t tile_byte = level.tilemap.map[map_idx];
-            uint16_t lut_value = level.tilemap.lut[tile_byte];
-            
-            const std::vector<uint8_t>* tile_pixels = nullptr;
-            
-            if (lut_value < 256) {
-                if (lut_value < level.local_tiles.tiles.size()) {
-                    tile_pixels = &level.local_tiles.tiles[lut_value];
-                }
-            } else if (lut_value < 256 + union_tileset.num_tiles) {
-                int union_idx = lut_value - 256;
-                if (union_idx < static_cast<int>(union_tileset.tiles.size())) {
-                    tile_pixels = &union_tileset.tiles[union_idx];
-                }
-            }
+    for (int ty = 0; ty < tiles_h; ty++) {
+        for (int tx = 0; tx < tiles_w; tx++) {
+            int map_idx = (tile_y + ty) * tilemap.width + tile_x + tx;
+            uint16_t lut_value = tilemap.lut[tilemap.map[map_idx]];
             
             // Skip first union tile (empty)
             if (lut_value == 256) {
                 continue;
             }
             
-            if (tile_pixels && !tile_pixels->empty()) {
-                for (int py = 0; py < 16; py++) {
-                    for (int px = 0; px < 16; px++) {
-                        int src_idx = py * 16 + px;
-                        if (src_idx >= static_cast<int>(tile_pixels->size())) continue;
-                        
-                        int dst_x = tx * 16 + px;
-                        int dst_y = ty * 16 + py;
-                        int dst_idx = dst_y * map_width + dst_x;
-                        
-                        uint8_t color_idx = (*tile_pixels)[src_idx];
-                        
-                        // Skip transparent (index 0)
-                        if (color_idx == 0) continue;
-                        
-                        uint8_t r = level.palette.r(color_idx);
-                        uint8_t g = level.palette.g(color_idx);
-                        uint8_t b = level.palette.b(color_idx);
-                        
-                        pixels[dst_idx] = (0xFF << 24) | (r << 16) | (g << 8) | b;
-                    }
-                }
+            const uint8_t* tile_pixels = find_tile(lut_value);
+            if (tile_pixels) {
+                draw_tile(tile_pixels, pixels + ty * 16 * pitch + tx * 16, pitch);
             }
         }
     }
+}
+
+// Rasterize chunks into textures. The tile rows of every chunk are split
+// into bands drawn in parallel on the worker pool; SDL calls stay on this
+// thread and the textures are uploaded once all bands are done.
+void Renderer::build_chunks(const std::vector<int>& indices) {
+    struct Job {
+        int index;
+        SDL_Surface* surface;
+        int tile_x, tile_y, tiles_w, tiles_h;
+    };
     
-    if (tilemap_texture) {
-        SDL_DestroyTexture(tilemap_texture);
+    const int chunk_tiles = CHUNK_SIZE / 16;
+    std::vector<Job> jobs;
+    for (int index : indices) {
+        // Edge chunks are cut to the map size
+        Job job;
+        job.index = index;
+        job.tile_x = index % chunks_x * chunk_tiles;
+        job.tile_y = index / chunks_x * chunk_tiles;
+        job.tiles_w = std::min(chunk_tiles, current_level->tilemap.width - job.tile_x);
+        job.tiles_h = std::min(chunk_tiles, current_level->tilemap.height - job.tile_y);
+        
+        job.surface = SDL_CreateRGBSurface(
+            0, job.tiles_w * 16, job.tiles_h * 16, 32,
+            0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000
+        );
+        if (!job.surface) continue;
+        
+        // Clear with transparent
+        SDL_FillRect(job.surface, nullptr, 0x00000000);
+        jobs.push_back(job);
     }
     
-    tilemap_texture = SDL_CreateTextureFromSurface(sdl_renderer, surface);
-    SDL_SetTextureBlendMode(tilemap_texture, SDL_BLENDMODE_BLEND);
+    if (!raster_pool) {
+        raster_pool.reset(new util::ThreadPool());
+    }
+    std::vector<std::future<void>> bands;
+    for (const Job& job : jobs) {
+        uint32_t* pixels = static_cast<uint32_t*>(job.surface->pixels);
+        int pitch = job.surface->pitch / 4;
+        for (int row = 0; row < job.tiles_h; row += RASTER_BAND_ROWS) {
+            int rows = std::min(RASTER_BAND_ROWS, job.tiles_h - row);
+            bands.push_back(raster_pool->submit([this, job, pixels, pitch, row, rows]() {
+                draw_tiles(pixels + row * 16 * pitch, pitch, job.tile_x, job.tile_y + row, job.tiles_w, rows);
+            }));
+        }
+    }
+    for (auto& band : bands) {
+        band.wait();
+    }
+    
+    for (const Job& job : jobs) {
+        TileChunk& chunk = chunks[job.index];
+        chunk.texture = SDL_CreateTextureFromSurface(sdl_renderer, job.surface);
+        SDL_FreeSurface(job.surface);
+        if (!chunk.texture) continue;
+        
+        SDL_SetTextureBlendMode(chunk.texture, SDL_BLENDMODE_BLEND);
+        chunk.bytes = static_cast<size_t>(job.tiles_w) * job.tiles_h * 16 * 16 * 4;
+        chunk_bytes += chunk.bytes;
+    }
+}
+
+// Drop least recently drawn chunks until under budget. Chunks drawn this
+// frame always stay.
+void Renderer::evict_chunks() {
+    while (chunk_bytes > chunk_budget) {
+        TileChunk* oldest = nullptr;
+        for (auto& chunk : chunks) {
+            if (chunk.texture && chunk.last_used < frame &&
+                (!oldest || chunk.last_used < oldest->last_used)) {
+                oldest = &chunk;
+            }
+        }
+        if (!oldest) break;
+        
+        SDL_DestroyTexture(oldest->texture);
+        oldest->texture = nullptr;
+        chunk_bytes -= oldest->bytes;
+        oldest->bytes = 0;
+    }
+}
+
+bool Renderer::build_atlas() {
+    atlas_slots = 256 + union_tiles->num_tiles;
+    atlas_width = ATLAS_COLUMNS * 16;
+    atlas_height = (atlas_slots + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS * 16;
+    
+    SDL_Surface* surface = SDL_CreateRGBSurface(
+        0, atlas_width, atlas_height, 32,
+        0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000
+    );
+    
+    if (!surface) {
+        return false;
+    }
+    
+    // Clear with transparent
+    SDL_FillRect(surface, nullptr, 0x00000000);
+    
+    uint32_t* pixels = static_cast<uint32_t*>(surface->pixels);
+    int pitch = surface->pitch / 4;
+    for (int slot = 0; slot < atlas_slots; slot++) {
+        const uint8_t* tile_pixels = find_tile(static_cast<uint16_t>(slot));
+        if (!tile_pixels) continue;
+        
+        int x = slot % ATLAS_COLUMNS * 16;
+        int y = slot / ATLAS_COLUMNS * 16;
+        draw_tile(tile_pixels, pixels + y * pitch + x, pitch);
+    }
+    
+    atlas_texture = SDL_CreateTextureFromSurface(sdl_renderer, surface);
     SDL_FreeSurface(surface);
+    if (!atlas_texture) {
+        return false;
+    }
+    
+    SDL_SetTextureBlendMode(atlas_texture, SDL_BLENDMODE_BLEND);
+    return true;
+}
+
+void Renderer::destroy_atlas() {
+    if (atlas_texture) {
+        SDL_DestroyTexture(atlas_texture);
+        atlas_texture = nullptr;
+    }
 }
 
 void Renderer::set_scroll(int x, int y) {
@@ -215,12 +451,84 @@ void Renderer::render() {
     SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 255);
     SDL_RenderClear(sdl_renderer);
     
-    render_background();
-    render_tilemap();
+    if (indexed) {
+        render_indexed();
+    } else {
+        render_background();
+        render_tilemap();
+    }
     
     SDL_RenderPresent(sdl_renderer);
 }
 
+// Compose background and tilemap as indices, then expand the whole frame
+// through the palette table into the streaming texture
+void Renderer::render_indexed() {
+    if (!frame_texture) {
+        frame_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (!frame_texture) return;
+    }
+    
+    if (background_indices.empty()) {
+        std::fill(framebuffer.begin(), framebuffer.end(), 0);
+    } else {
+        std::copy(background_indices.begin(), background_indices.end(), framebuffer.begin());
+    }
+    if (current_level) {
+        compose_tilemap_indexed();
+    }
+    
+    void* texture_pixels;
+    int pitch;
+    if (SDL_LockTexture(frame_texture, nullptr, &texture_pixels, &pitch) != 0) {
+        return;
+    }
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint8_t* src = framebuffer.data() + y * SCREEN_WIDTH;
+        uint32_t* dst = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(texture_pixels) + y * pitch);
+        kernels::indexed_to_argb(src, SCREEN_WIDTH, palette_lut, dst);
+    }
+    SDL_UnlockTexture(frame_texture);
+    
+    SDL_RenderCopy(sdl_renderer, frame_texture, nullptr, nullptr);
+}
+
+// Copy the visible tiles into the framebuffer, clipped to the screen.
+// Index 0 and the first union tile let the background show through.
+void Renderer::compose_tilemap_indexed() {
+    const assets::Tilemap& tilemap = current_level->tilemap;
+    int first_tx = scroll_x / 16;
+    int first_ty = scroll_y / 16;
+    int last_tx = std::min((scroll_x + SCREEN_WIDTH - 1) / 16, tilemap.width - 1);
+    int last_ty = std::min((scroll_y + SCREEN_HEIGHT - 1) / 16, tilemap.height - 1);
+    
+    for (int ty = first_ty; ty <= last_ty; ty++) {
+        for (int tx = first_tx; tx <= last_tx; tx++) {
+            uint16_t lut_value = tilemap.lut[tilemap.map[ty * tilemap.width + tx]];
+            if (lut_value == 256) continue;
+            
+            const uint8_t* tile_pixels = find_tile(lut_value);
+            if (!tile_pixels) continue;
+            
+            int dst_x = tx * 16 - scroll_x;
+            int dst_y = ty * 16 - scroll_y;
+            int x0 = std::max(0, -dst_x);
+            int y0 = std::max(0, -dst_y);
+            int x1 = std::min(16, SCREEN_WIDTH - dst_x);
+            int y1 = std::min(16, SCREEN_HEIGHT - dst_y);
+            
+            for (int py = y0; py < y1; py++) {
+                const uint8_t* src_row = tile_pixels + py * 16;
+                uint8_t* dst_row = framebuffer.data() + (dst_y + py) * SCREEN_WIDTH + dst_x;
+                for (int px = x0; px < x1; px++) {
+                    if (src_row[px] != 0) dst_row[px] = src_row[px];
+                }
+            }
+        }
+    }
+}
+
 void Renderer::render_background() {
     if (background_texture) {
         SDL_RenderCopy(sdl_renderer, background_texture, nullptr, nullptr);
@@ -228,11 +536,113 @@ void Renderer::render_background() {
 }
 
 void Renderer::render_tilemap() {
-    if (tilemap_texture) {
-        SDL_Rect src = {scroll_x, scroll_y, SCREEN_WIDTH, SCREEN_HEIGHT};
-        SDL_Rect dst = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-        SDL_RenderCopy(sdl_renderer, tilemap_texture, &src, &dst);
+    if (!current_level) return;
+    if (tilemap_mode == TilemapMode::Atlas) {
+        render_tilemap_atlas();
+        return;
+    }
+    frame++;
+    
+    // Only the chunks overlapping the viewport
+    int first_cx = scroll_x / CHUNK_SIZE;
+    int first_cy = scroll_y / CHUNK_SIZE;
+    int last_cx = std::min((scroll_x + SCREEN_WIDTH - 1) / CHUNK_SIZE, chunks_x - 1);
+    int last_cy = std::min((scroll_y + SCREEN_HEIGHT - 1) / CHUNK_SIZE, chunks_y - 1);
+    
+    // Chunks scrolling into view are built together so their bands share
+    // the pool
+    std::vector<int> missing;
+    for (int cy = first_cy; cy <= last_cy; cy++) {
+        for (int cx = first_cx; cx <= last_cx; cx++) {
+            TileChunk& chunk = chunks[cy * chunks_x + cx];
+            chunk.last_used = frame;
+            if (!chunk.texture) missing.push_back(cy * chunks_x + cx);
+        }
+    }
+    if (!missing.empty()) {
+        build_chunks(missing);
+    }
+    
+    for (int cy = first_cy; cy <= last_cy; cy++) {
+        for (int cx = first_cx; cx <= last_cx; cx++) {
+            SDL_Texture* texture = chunks[cy * chunks_x + cx].texture;
+            if (!texture) continue;
+            
+            int x = cx * CHUNK_SIZE;
+            int y = cy * CHUNK_SIZE;
+            int w = std::min(CHUNK_SIZE, current_level->tilemap.width * 16 - x);
+            int h = std::min(CHUNK_SIZE, current_level->tilemap.height * 16 - y);
+            SDL_Rect dst = {x - scroll_x, y - scroll_y, w, h};
+            SDL_RenderCopy(sdl_renderer, texture, nullptr, &dst);
+        }
+    }
+    
+    evict_chunks();
+}
+
+// Draw the visible tiles straight from the atlas, reading the map every
+// frame so tile edits show up immediately. All tiles go out in one
+// SDL_RenderGeometry batch where available (SDL 2.0.18+).
+void Renderer::render_tilemap_atlas() {
+    if (!atlas_texture && !build_atlas()) return;
+    
+    const assets::Tilemap& tilemap = current_level->tilemap;
+    int first_tx = scroll_x / 16;
+    int first_ty = scroll_y / 16;
+    int last_tx = std::min((scroll_x + SCREEN_WIDTH - 1) / 16, tilemap.width - 1);
+    int last_ty = std::min((scroll_y + SCREEN_HEIGHT - 1) / 16, tilemap.height - 1);
+    
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    tile_vertices.clear();
+    tile_indices.clear();
+    const float u_scale = 1.0f / atlas_width;
+    const float v_scale = 1.0f / atlas_height;
+    const SDL_Color white = {255, 255, 255, 255};
+#endif
+    
+    for (int ty = first_ty; ty <= last_ty; ty++) {
+        for (int tx = first_tx; tx <= last_tx; tx++) {
+            uint16_t lut_value = tilemap.lut[tilemap.map[ty * tilemap.width + tx]];
+            
+            // Skip first union tile (empty) and tiles the atlas lacks
+            if (lut_value == 256 || !find_tile(lut_value)) {
+                continue;
+            }
+            
+            int src_x = lut_value % ATLAS_COLUMNS * 16;
+            int src_y = lut_value / ATLAS_COLUMNS * 16;
+            int dst_x = tx * 16 - scroll_x;
+            int dst_y = ty * 16 - scroll_y;
+            
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+            float x0 = static_cast<float>(dst_x), x1 = x0 + 16;
+            float y0 = static_cast<float>(dst_y), y1 = y0 + 16;
+            float u0 = src_x * u_scale, u1 = (src_x + 16) * u_scale;
+            float v0 = src_y * v_scale, v1 = (src_y + 16) * v_scale;
+            
+            int base = static_cast<int>(tile_vertices.size());
+            tile_vertices.push_back({{x0, y0}, white, {u0, v0}});
+            tile_vertices.push_back({{x1, y0}, white, {u1, v0}});
+            tile_vertices.push_back({{x0, y1}, white, {u0, v1}});
+            tile_vertices.push_back({{x1, y1}, white, {u1, v1}});
+            for (int corner : {0, 1, 2, 2, 1, 3}) {
+                tile_indices.push_back(base + corner);
+            }
+#else
+            SDL_Rect src = {src_x, src_y, 16, 16};
+            SDL_Rect dst = {dst_x, dst_y, 16, 16};
+            SDL_RenderCopy(sdl_renderer, atlas_texture, &src, &dst);
+#endif
+        }
+    }
+    
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (!tile_indices.empty()) {
+        SDL_RenderGeometry(sdl_renderer, atlas_texture,
+                           tile_vertices.data(), static_cast<int>(tile_vertices.size()),
+                           tile_indices.data(), static_cast<int>(tile_indices.size()));
     }
+#endif
 }
 
 bool Renderer::process_events() {
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "asset_converter.h"
+#include "thread_pool.h"
 #include <SDL2/SDL.h>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace renderer {
 
@@ -12,15 +15,47 @@ public:
     static const int SCREEN_HEIGHT = 200;
     static const int SCALE = 3;
     
+    // The tilemap is drawn from square chunk textures, each built the first
+    // time it scrolls into view. Once their total size exceeds the budget
+    // the least recently drawn chunks are dropped.
+    static constexpr int CHUNK_SIZE = 512;
+    static constexpr size_t DEFAULT_CHUNK_BUDGET = 32 * 1024 * 1024;
+    
+    // How the tilemap is drawn
+    enum class TilemapMode {
+        Chunks,  // Pre-rasterized chunk textures (above)
+        Atlas    // Visible tiles batched from one tile atlas each frame
+    };
+    
     Renderer();
     ~Renderer();
     
     bool init(const char* title = "Prehistorik 2");
     void shutdown();
     
+    // Still screens carry their own palette; level backgrounds and tiles
+    // are shared with the asset caches and drawn with the level palette.
+    // The union tiles must come from the same Context as the level.
     void set_background(const assets::Image& image);
-    void set_tilemap(const assets::LevelData& level);
+    void set_background(std::shared_ptr<const assets::Image> image, const assets::Palette& image_palette);
+    void set_tilemap(std::shared_ptr<const assets::LevelData> level,
+                     std::shared_ptr<const assets::Tileset> level_union_tiles,
+                     const assets::Palette& level_palette);
     void clear_tilemap();
+    void set_chunk_budget(size_t bytes);
+    void set_tilemap_mode(TilemapMode mode);
+    TilemapMode get_tilemap_mode() const { return tilemap_mode; }
+    
+    // Indexed rendering: background and tilemap are composed as 8bpp
+    // palette indices and expanded to ARGB through a 256-entry lookup table
+    // in one streaming texture update per frame. A frame has one palette:
+    // the level palette while a tilemap is shown, otherwise the background
+    // palette. Palette changes below only touch the table, so they have no
+    // effect on direct rendering.
+    void set_indexed(bool enabled);
+    bool is_indexed() const { return indexed; }
+    void set_palette(const assets::Palette& palette);
+    void set_fade(int level);  // 0 (black) to 256 (full)
     void set_scroll(int x, int y);
     
     void render();
@@ -33,10 +68,54 @@ public:
 private:
     SDL_Window* window = nullptr;
     SDL_Renderer* sdl_renderer = nullptr;
-    SDL_Texture* background_texture = nullptr;
-    SDL_Texture* tilemap_texture = nullptr;
+    SDL_Texture* background_texture = nullptr;  // Built on demand from background_image
+    std::shared_ptr<const assets::Image> background_image;
+    assets::Palette background_palette;
+    
+    struct TileChunk {
+        SDL_Texture* texture = nullptr;
+        size_t bytes = 0;
+        uint64_t last_used = 0;  // Frame it was last drawn
+    };
+    
+    std::shared_ptr<const assets::LevelData> current_level;
+    std::shared_ptr<const assets::Tileset> union_tiles;
+    std::vector<TileChunk> chunks;  // Row-major, chunks_x by chunks_y
+    int chunks_x = 0;
+    int chunks_y = 0;
+    size_t chunk_bytes = 0;
+    size_t chunk_budget = DEFAULT_CHUNK_BUDGET;
+    uint64_t frame = 0;
+    assets::Palette level_palette;
+    uint32_t tile_lut[256] = {};  // Level palette as ARGB, for tile expansion
+    
+    // Chunk rasterization runs in bands of this many tile rows on the pool
+    // (one worker per core, started with the first chunk)
+    static constexpr int RASTER_BAND_ROWS = 4;
+    std::unique_ptr<util::ThreadPool> raster_pool;
+    
+    // Atlas mode: union and local tiles of the level in one texture, slot
+    // n holding LUT value n, and the geometry of the visible tiles
+    static constexpr int ATLAS_COLUMNS = 32;
+    TilemapMode tilemap_mode = TilemapMode::Chunks;
+    SDL_Texture* atlas_texture = nullptr;
+    int atlas_width = 0;
+    int atlas_height = 0;
+    int atlas_slots = 0;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> tile_vertices;
+    std::vector<int> tile_indices;
+#endif
     
-    const assets::LevelData* current_level = nullptr;
+    // Indexed mode: screen-sized index framebuffer, the background scaled
+    // to the screen, and the palette as ARGB
+    bool indexed = false;
+    std::vector<uint8_t> framebuffer;
+    std::vector<uint8_t> background_indices;
+    assets::Palette palette;
+    int fade = 256;
+    uint32_t palette_lut[256] = {};
+    SDL_Texture* frame_texture = nullptr;
     
     int scroll_x = 0;
     int scroll_y = 0;
@@ -48,7 +127,20 @@ private:
     
     void render_background();
     void render_tilemap();
-    SDL_Texture* create_texture_from_image(const assets::Image& image);
+    void render_tilemap_atlas();
+    void render_indexed();
+    void compose_tilemap_indexed();
+    void update_palette_lut();
+    void select_palette();
+    void build_chunks(const std::vector<int>& indices);
+    const uint8_t* find_tile(uint16_t lut_value) const;
+    void draw_tile(const uint8_t* tile_pixels, uint32_t* dst, int pitch) const;
+    void draw_tiles(uint32_t* pixels, int pitch, int tile_x, int tile_y, int tiles_w, int tiles_h) const;
+    void evict_chunks();
+    void destroy_chunks();
+    bool build_atlas();
+    void destroy_atlas();
+    SDL_Texture* create_texture_from_image(const assets::Image& image, const assets::Palette& image_palette);
 };
 
 } // namespace renderer
@@ -0,0 +1,452 @@
+#include "sqz_packer.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+namespace sqz {
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+static const size_t TTF_MAX_PAYLOAD = 0xFFFFF;
+static const size_t DIET_MAX_PAYLOAD = 0x1FFFFF;
+
+static const int LZW_FIRST_CODE = 0x102;
+static const int LZW_MAX_CODES = 0x1000;
+
+static const size_t DIET_WINDOW = 0x2000;
+static const size_t DIET_MAX_MATCH = 272;     // 15 + 255 + 2
+static const size_t DIET_SHORT_WINDOW = 0x900;  // Farthest 2-byte match
+static const int DIET_CHAIN_DEPTH = 64;
+
+// ============================================================================
+// Bit Writers
+// ============================================================================
+
+// MSB-first bit packer used by both TTF formats
+class MsbBitWriter {
+public:
+    explicit MsbBitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void write(uint32_t value, int nbits) {
+        for (int i = nbits - 1; i >= 0; i--) {
+            acc = (acc << 1) | ((value >> i) & 1);
+            if (++count == 8) {
+                out.push_back(static_cast<uint8_t>(acc));
+                acc = 0;
+                count = 0;
+            }
+        }
+    }
+
+    void flush() {
+        if (count) {
+            out.push_back(static_cast<uint8_t>(acc << (8 - count)));
+            acc = 0;
+            count = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint32_t acc = 0;
+    int count = 0;
+};
+
+// DIET interleaves 16-bit LSB-first control words with literal bytes. The
+// decoder loads the next word as soon as the current one is used up, so a
+// word's slot is reserved before any byte that follows its first bit.
+class DietBitWriter {
+public:
+    explicit DietBitWriter(std::vector<uint8_t>& out) : out(out) { reserve_word(); }
+
+    void write_bit(int bit) {
+        if (bit) word |= static_cast<uint16_t>(1u << count);
+        out[word_pos] = static_cast<uint8_t>(word & 0xFF);
+        out[word_pos + 1] = static_cast<uint8_t>(word >> 8);
+        if (++count == 16) reserve_word();
+    }
+
+    // Bits in the order the decoder shifts them in
+    void write_bits_msb(int value, int nbits) {
+        for (int i = nbits - 1; i >= 0; i--) write_bit((value >> i) & 1);
+    }
+
+    void write_byte(uint8_t value) { out.push_back(value); }
+
+private:
+    std::vector<uint8_t>& out;
+    size_t word_pos = 0;
+    uint16_t word = 0;
+    int count = 0;
+
+    void reserve_word() {
+        word_pos = out.size();
+        out.push_back(0);
+        out.push_back(0);
+        word = 0;
+        count = 0;
+    }
+};
+
+// ============================================================================
+// TTF Header
+// ============================================================================
+
+static void write_ttf_header(std::vector<uint8_t>& out, size_t size, uint8_t type) {
+    if (size > TTF_MAX_PAYLOAD) {
+        throw std::runtime_error("Payload too large for TTF archive");
+    }
+    out.push_back(static_cast<uint8_t>((size >> 16) & 0x0F));
+    out.push_back(type);
+    out.push_back(static_cast<uint8_t>(size & 0xFF));
+    out.push_back(static_cast<uint8_t>((size >> 8) & 0xFF));
+}
+
+// ============================================================================
+// LZW Compression
+// ============================================================================
+
+// Code width the decoder uses for the given dictionary size
+static int lzw_code_width(int dictsize) {
+    if (dictsize < 0x200) return 9;
+    if (dictsize < 0x400) return 10;
+    if (dictsize < 0x800) return 11;
+    return 12;
+}
+
+std::vector<uint8_t> pack_lzw(const uint8_t* data, size_t size, bool alt_codes) {
+    std::vector<uint8_t> out;
+    write_ttf_header(out, size, 0x10);
+
+    const int code_clear = alt_codes ? 0x101 : 0x100;
+    const int code_end = alt_codes ? 0x100 : 0x101;
+    MsbBitWriter writer(out);
+
+    // child[prefix * 256 + byte] is the code for prefix+byte, 0 if absent
+    std::vector<uint16_t> child(LZW_MAX_CODES * 256, 0);
+    int next_code = LZW_FIRST_CODE;
+
+    // The decoder adds a dictionary entry for every code after the first
+    // since a clear, and widens its codes one entry behind the encoder
+    int emitted = 0;
+    auto emit = [&](int code) {
+        int dictsize = emitted == 0 ? LZW_FIRST_CODE
+                                    : std::min(LZW_FIRST_CODE + emitted - 1, LZW_MAX_CODES);
+        writer.write(code, lzw_code_width(dictsize));
+        emitted++;
+    };
+
+    if (size > 0) {
+        int prefix = data[0];
+        for (size_t i = 1; i < size; i++) {
+            uint8_t c = data[i];
+            uint16_t code = child[prefix * 256 + c];
+            if (code) {
+                prefix = code;
+                continue;
+            }
+
+            emit(prefix);
+            if (next_code < LZW_MAX_CODES) {
+                child[prefix * 256 + c] = static_cast<uint16_t>(next_code++);
+            }
+            if (next_code == LZW_MAX_CODES) {
+                emit(code_clear);
+                std::fill(child.begin(), child.end(), 0);
+                next_code = LZW_FIRST_CODE;
+                emitted = 0;
+            }
+            prefix = c;
+        }
+        emit(prefix);
+    }
+
+    emit(code_end);
+    writer.flush();
+    return out;
+}
+
+// ============================================================================
+// Huffman RLE Compression
+// ============================================================================
+
+// Symbols 0x00-0xFF are literals; 0x100 | n repeats the previous byte n
+// times (n >= 2); 0x101 is followed by the high and low count bytes
+static std::vector<int> tokenize_rle(const uint8_t* data, size_t size) {
+    std::vector<int> symbols;
+    uint8_t last = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        size_t run = 0;
+        while (i + run < size && data[i + run] == last && run < 0xFFFF) run++;
+
+        if (run >= 2) {
+            if (run <= 0xFF) {
+                symbols.push_back(0x100 | static_cast<int>(run));
+            } else {
+                symbols.push_back(0x101);
+                symbols.push_back(static_cast<int>(run >> 8));
+                symbols.push_back(static_cast<int>(run & 0xFF));
+            }
+            i += run;
+        } else {
+            last = data[i++];
+            symbols.push_back(last);
+        }
+    }
+
+    return symbols;
+}
+
+struct HuffmanNode {
+    uint32_t freq;
+    int symbol;  // -1 for internal nodes
+    int left;
+    int right;
+};
+
+std::vector<uint8_t> pack_huffman_rle(const uint8_t* data, size_t size) {
+    std::vector<uint8_t> out;
+    write_ttf_header(out, size, 0x00);
+
+    std::vector<int> symbols = tokenize_rle(data, size);
+    std::vector<uint32_t> freq(0x200, 0);
+    for (int s : symbols) freq[s]++;
+
+    // Build the code tree
+    using QueueItem = std::pair<uint32_t, int>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    std::vector<HuffmanNode> nodes;
+    for (int s = 0; s < 0x200; s++) {
+        if (freq[s]) {
+            nodes.push_back({freq[s], s, -1, -1});
+            queue.push({freq[s], static_cast<int>(nodes.size()) - 1});
+        }
+    }
+
+    // The root must be an internal node, so pad to at least two leaves
+    while (nodes.size() < 2) {
+        int filler = (!nodes.empty() && nodes[0].symbol == 0) ? 1 : 0;
+        nodes.push_back({0, filler, -1, -1});
+        queue.push({0, static_cast<int>(nodes.size()) - 1});
+    }
+
+    while (queue.size() > 1) {
+        QueueItem a = queue.top(); queue.pop();
+        QueueItem b = queue.top(); queue.pop();
+        nodes.push_back({a.first + b.first, -1, a.second, b.second});
+        queue.push({a.first + b.first, static_cast<int>(nodes.size()) - 1});
+    }
+    int root = queue.top().second;
+
+    // Serialise breadth-first as child pairs: an internal node stores the
+    // byte offset of its pair, a leaf stores 0x8000 | symbol
+    struct Slot { int node; size_t index; uint32_t code; int length; };
+    std::vector<uint16_t> tree(2);
+    std::vector<uint32_t> codes(0x200, 0);
+    std::vector<int> lengths(0x200, 0);
+    std::vector<Slot> pending = {
+        {nodes[root].left, 0, 0, 1},
+        {nodes[root].right, 1, 1, 1}
+    };
+
+    for (size_t i = 0; i < pending.size(); i++) {
+        Slot slot = pending[i];
+        const HuffmanNode& node = nodes[slot.node];
+        if (node.symbol >= 0) {
+            tree[slot.index] = static_cast<uint16_t>(0x8000 | node.symbol);
+            codes[node.symbol] = slot.code;
+            lengths[node.symbol] = slot.length;
+        } else {
+            size_t pair = tree.size();
+            tree.resize(pair + 2);
+            tree[slot.index] = static_cast<uint16_t>(pair * 2);
+            pending.push_back({node.left, pair, slot.code << 1, slot.length + 1});
+            pending.push_back({node.right, pair + 1, (slot.code << 1) | 1, slot.length + 1});
+        }
+    }
+
+    size_t tree_bytes = tree.size() * 2;
+    out.push_back(static_cast<uint8_t>(tree_bytes & 0xFF));
+    out.push_back(static_cast<uint8_t>(tree_bytes >> 8));
+    for (uint16_t entry : tree) {
+        out.push_back(static_cast<uint8_t>(entry & 0xFF));
+        out.push_back(static_cast<uint8_t>(entry >> 8));
+    }
+
+    MsbBitWriter writer(out);
+    for (int s : symbols) writer.write(codes[s], lengths[s]);
+    writer.flush();
+    return out;
+}
+
+// ============================================================================
+// DIET Compression
+// ============================================================================
+
+static void write_diet_match(DietBitWriter& writer, size_t distance, size_t length) {
+    int offset = -static_cast<int>(distance);
+    uint8_t lo = static_cast<uint8_t>(offset & 0xFF);
+    uint8_t hi = static_cast<uint8_t>((offset >> 8) & 0xFF);
+
+    writer.write_bit(0);
+
+    if (length == 2) {
+        writer.write_bit(0);
+        writer.write_byte(lo);
+        if (hi == 0xFF) {
+            writer.write_bit(0);
+        } else {
+            writer.write_bit(1);
+            writer.write_bits_msb(hi + 1 - 0xF8, 3);
+        }
+        return;
+    }
+
+    // High offset byte, variable length
+    writer.write_bit(1);
+    writer.write_byte(lo);
+    if (hi >= 0xFE) {
+        writer.write_bit(hi & 1);
+        writer.write_bit(1);
+    } else if (hi >= 0xFC) {
+        writer.write_bit(hi & 1);
+        writer.write_bits_msb(0x1, 2);
+    } else if (hi >= 0xF8) {
+        int x = hi - 0xF8;
+        writer.write_bit(x >> 1);
+        writer.write_bits_msb(0x0, 2);
+        writer.write_bit(x & 1);
+        writer.write_bit(1);
+    } else if (hi >= 0xF0) {
+        int x = hi - 0xF0;
+        writer.write_bit(x >> 2);
+        writer.write_bits_msb(0x0, 2);
+        writer.write_bit((x >> 1) & 1);
+        writer.write_bit(0);
+        writer.write_bit(x & 1);
+        writer.write_bit(1);
+    } else {
+        int x = hi - 0xE0;
+        writer.write_bit(x >> 3);
+        writer.write_bits_msb(0x0, 2);
+        writer.write_bit((x >> 2) & 1);
+        writer.write_bit(0);
+        writer.write_bit((x >> 1) & 1);
+        writer.write_bit(0);
+        writer.write_bit(x & 1);
+    }
+
+    // Repeat count, variable length
+    int count = static_cast<int>(length) - 2;
+    if (count <= 4) {
+        for (int k = 1; k < count; k++) writer.write_bit(0);
+        writer.write_bit(1);
+    } else {
+        writer.write_bits_msb(0x0, 4);
+        if (count <= 6) {
+            writer.write_bit(1);
+            writer.write_bit(count == 6);
+        } else if (count <= 14) {
+            writer.write_bits_msb(0x0, 2);
+            writer.write_bits_msb(count - 7, 3);
+        } else {
+            writer.write_bits_msb(0x1, 2);
+            writer.write_byte(static_cast<uint8_t>(count - 15));
+        }
+    }
+}
+
+std::vector<uint8_t> pack_diet(const uint8_t* data, size_t size) {
+    if (size > DIET_MAX_PAYLOAD) {
+        throw std::runtime_error("Payload too large for DIET archive");
+    }
+
+    // Signature, then five bytes the decoder ignores (left zero), then size
+    std::vector<uint8_t> out = {0xB4, 0x4C, 0xCD, 0x21, 0x9D, 0x89, 0x64, 0x6C, 0x7A,
+                                0x00, 0x00, 0x00, 0x00, 0x00};
+    out.push_back(static_cast<uint8_t>(((size >> 16) & 0x1F) << 2));
+    out.push_back(static_cast<uint8_t>(size & 0xFF));
+    out.push_back(static_cast<uint8_t>((size >> 8) & 0xFF));
+
+    DietBitWriter writer(out);
+
+    // Hash chains over 2-byte prefixes
+    std::vector<int64_t> head(1 << 16, -1);
+    std::vector<int64_t> prev(size, -1);
+    auto insert = [&](size_t pos) {
+        if (pos + 1 < size) {
+            int key = (data[pos] << 8) | data[pos + 1];
+            prev[pos] = head[key];
+            head[key] = static_cast<int64_t>(pos);
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+
+        if (pos + 1 < size) {
+            int64_t candidate = head[(data[pos] << 8) | data[pos + 1]];
+            for (int depth = 0; candidate >= 0 && depth < DIET_CHAIN_DEPTH; depth++) {
+                size_t distance = pos - static_cast<size_t>(candidate);
+                if (distance > DIET_WINDOW) break;
+
+                size_t length = 0;
+                while (pos + length < size && length < DIET_MAX_MATCH &&
+                       data[candidate + length] == data[pos + length]) {
+                    length++;
+                }
+
+                bool usable = length >= 3 ||
+                              (length == 2 && distance != 1 && distance <= DIET_SHORT_WINDOW);
+                if (usable && length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                }
+                candidate = prev[candidate];
+            }
+        }
+
+        if (best_length < 2) {
+            writer.write_bit(1);
+            writer.write_byte(data[pos]);
+            insert(pos);
+            pos++;
+            continue;
+        }
+
+        write_diet_match(writer, best_distance, best_length);
+        for (size_t k = 0; k < best_length; k++) insert(pos + k);
+        pos += best_length;
+    }
+
+    // End marker: a 2+ byte match with low offset 0xFF and no high bits
+    writer.write_bits_msb(0x0, 2);
+    writer.write_byte(0xFF);
+    writer.write_bit(0);
+    return out;
+}
+
+// ============================================================================
+// Format Dispatch
+// ============================================================================
+
+std::vector<uint8_t> pack(Format format, const uint8_t* data, size_t size) {
+    switch (format) {
+        case Format::Lzw:
+            return pack_lzw(data, size);
+        case Format::HuffmanRle:
+            return pack_huffman_rle(data, size);
+        case Format::Diet:
+            return pack_diet(data, size);
+    }
+    throw std::runtime_error("Unknown SQZ format");
+}
+
+} // namespace sqz
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "sqz_unpacker.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace sqz {
+
+// Encoders for the three SQZ formats. Every archive they produce unpacks
+// bit-exactly with sqz::unpack (or unpack_alt_lzw for alt_codes).
+
+// TTF LZW (type 0x10), payload at most 0xFFFFF bytes. alt_codes swaps the
+// clear and end codes.
+std::vector<uint8_t> pack_lzw(const uint8_t* data, size_t size, bool alt_codes = false);
+
+// TTF Huffman + RLE, payload at most 0xFFFFF bytes
+std::vector<uint8_t> pack_huffman_rle(const uint8_t* data, size_t size);
+
+// DIET, payload at most 0x1FFFFF bytes
+std::vector<uint8_t> pack_diet(const uint8_t* data, size_t size);
+
+// Encode with the given format
+std::vector<uint8_t> pack(Format format, const uint8_t* data, size_t size);
+
+} // namespace sqz
@@ -1,100 +1,260 @@
 #include "sqz_unpacker.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
-#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace sqz {
 
+// ============================================================================
+// Memory-Mapped Input
+// ============================================================================
+
+MappedFile::MappedFile(const std::string& filename) {
+#ifdef _WIN32
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    ptr = fallback.data();
+    length = fallback.size();
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat file: " + filename);
+    }
+    
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0) {
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map file: " + filename);
+        }
+        ptr = static_cast<const uint8_t*>(mapping);
+    }
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (ptr) {
+        munmap(const_cast<uint8_t*>(ptr), length);
+    }
+#endif
+}
+
 // ============================================================================
 // Bit Readers
 // ============================================================================
 
-class LzwCodeWordReader {
-    std::istream& stream;
-    uint32_t buf24 = 0;
-    int missing_bits = 0;
+static uint16_t read_le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint64_t read_be64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// MSB-first bit buffer shared by the LZW and Huffman readers. Bits are kept
+// left-aligned in a 64-bit register and refilled a whole word at a time
+// while at least 8 input bytes remain.
+class MsbBitBuffer {
+protected:
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint64_t bitbuf = 0;
+    int bitcount = 0;
+    
+    void refill() {
+        if (end - cur >= 8) {
+            bitbuf |= read_be64(cur) >> bitcount;
+            cur += (63 - bitcount) >> 3;
+            bitcount |= 56;
+        } else {
+            while (bitcount <= 56 && cur < end) {
+                bitbuf |= static_cast<uint64_t>(*cur++) << (56 - bitcount);
+                bitcount += 8;
+            }
+        }
+    }
     
 public:
-    LzwCodeWordReader(std::istream& s) : stream(s) {
-        uint8_t b1, b2, b3;
-        stream.read(reinterpret_cast<char*>(&b1), 1);
-        stream.read(reinterpret_cast<char*>(&b2), 1);
-        stream.read(reinterpret_cast<char*>(&b3), 1);
-        buf24 = (b1 << 16) | (b2 << 8) | b3;
+    MsbBitBuffer(const uint8_t* begin, const uint8_t* end) : cur(begin), end(end) {}
+    
+    // Input position, for callers that move or extend the input buffer
+    const uint8_t* position() const { return cur; }
+    size_t remaining() const { return static_cast<size_t>(end - cur); }
+    void reseat(const uint8_t* new_cur, const uint8_t* new_end) {
+        cur = new_cur;
+        end = new_end;
     }
+};
+
+class LzwCodeWordReader : MsbBitBuffer {
+public:
+    using MsbBitBuffer::position;
+    using MsbBitBuffer::remaining;
+    using MsbBitBuffer::reseat;
+    
+    LzwCodeWordReader(const uint8_t* begin, const uint8_t* end) : MsbBitBuffer(begin, end) {}
     
     int read_codeword(int nbit) {
-        int cw = buf24 >> (24 - nbit);
-        buf24 = (buf24 << nbit) & 0xFFFFFF;
-        missing_bits += nbit;
-        
-        while (missing_bits >= 8 && stream.good()) {
-            missing_bits -= 8;
-            uint8_t b;
-            if (stream.read(reinterpret_cast<char*>(&b), 1)) {
-                buf24 |= (b << missing_bits);
+        if (bitcount < nbit) {
+            refill();
+            if (bitcount < nbit) {
+                throw std::runtime_error("Truncated LZW data");
             }
         }
+        int cw = static_cast<int>(bitbuf >> (64 - nbit));
+        bitbuf <<= nbit;
+        bitcount -= nbit;
         return cw;
     }
 };
 
-class BitReader {
-    std::istream& stream;
-    int bit = 8;
-    uint8_t current_byte = 0;
-    
+class BitReader : MsbBitBuffer {
 public:
-    BitReader(std::istream& s) : stream(s) {}
+    using MsbBitBuffer::position;
+    using MsbBitBuffer::remaining;
+    using MsbBitBuffer::reseat;
+    
+    BitReader(const uint8_t* begin, const uint8_t* end) : MsbBitBuffer(begin, end) {}
     
     bool is_eof() {
-        return (bit == 8) && !stream.good();
+        if (bitcount == 0) {
+            refill();
+        }
+        return bitcount == 0;
     }
     
-    bool read_bit(bool big_endian = false) {
-        if (bit == 8) {
-            stream.read(reinterpret_cast<char*>(&current_byte), 1);
-            bit = 0;
+    bool read_bit() {
+        if (bitcount == 0) {
+            refill();
         }
-        int shift = big_endian ? (7 - bit) : bit;
-        bool value = (current_byte & (1 << shift)) != 0;
-        bit++;
+        bool value = (bitbuf >> 63) != 0;
+        bitbuf <<= 1;
+        bitcount--;
         return value;
     }
+    
+    // Number of buffered bits after topping up, at most 56 unless at the end
+    int ensure_bits(int nbit) {
+        if (bitcount < nbit) {
+            refill();
+        }
+        return bitcount;
+    }
+    
+    // Next nbit bits without consuming them; missing input reads as zero
+    uint32_t peek_bits(int nbit) const {
+        return static_cast<uint32_t>(bitbuf >> (64 - nbit));
+    }
+    
+    void skip_bits(int nbit) {
+        bitbuf <<= nbit;
+        bitcount -= nbit;
+    }
 };
 
+// DIET interleaves 16-bit LSB-first bit words with literal bytes, and the
+// next word is fetched as soon as the last bit of the current one is used.
+// The position of a word is therefore only known once its predecessor is
+// exhausted, so at most one word can be buffered ahead of the byte stream.
 class DietBitReader {
-    std::istream& stream;
-    int bit = 0;
-    uint16_t current_word = 0;
+    const uint8_t* cur;
+    const uint8_t* end;
+    uint32_t bitbuf = 0;   // Unread bits of the current word, next bit in bit 0
+    int bits_left = 0;
+    
+    void next_word() {
+        if (end - cur >= 2) {
+            bitbuf = read_le16(cur);
+            cur += 2;
+        } else {
+            // The final word may be fetched eagerly after the last
+            // payload byte; treat missing input as zero bits.
+            bitbuf = 0;
+            cur = end;
+        }
+        bits_left = 16;
+    }
     
 public:
-    DietBitReader(std::istream& s) : stream(s) {
-        stream.read(reinterpret_cast<char*>(&current_word), 2);
+    DietBitReader(const uint8_t* begin, const uint8_t* end) : cur(begin), end(end) {
+        next_word();
+    }
+    
+    const uint8_t* position() const { return cur; }
+    size_t remaining() const { return static_cast<size_t>(end - cur); }
+    void reseat(const uint8_t* new_cur, const uint8_t* new_end) {
+        cur = new_cur;
+        end = new_end;
     }
     
     bool read_bit() {
-        bool value = (current_word & (1 << bit)) != 0;
-        bit++;
-        if (bit == 16) {
-            stream.read(reinterpret_cast<char*>(&current_word), 2);
-            bit = 0;
+        bool value = (bitbuf & 1) != 0;
+        bitbuf >>= 1;
+        if (--bits_left == 0) {
+            next_word();
         }
         return value;
     }
     
-    int read_3bit_value() {
-        int value = 0;
-        for (int i = 0; i < 3; i++) {
-            value = (value << 1) | (read_bit() ? 1 : 0);
+    // Read up to 16 bits at once; the first bit read ends up in bit 0
+    uint32_t read_bits(int nbit) {
+        if (nbit < bits_left) {
+            uint32_t value = bitbuf & ((1u << nbit) - 1);
+            bitbuf >>= nbit;
+            bits_left -= nbit;
+            return value;
         }
+        
+        int have = bits_left;
+        uint32_t value = bitbuf;
+        next_word();
+        int rest = nbit - have;
+        value |= (bitbuf & ((1u << rest) - 1)) << have;
+        bitbuf >>= rest;
+        bits_left -= rest;
         return value;
     }
     
+    int read_3bit_value() {
+        // The value is stored most significant bit first
+        static const uint8_t reversed[8] = {0, 4, 2, 6, 1, 5, 3, 7};
+        return reversed[read_bits(3)];
+    }
+    
     uint8_t read_next_byte() {
-        uint8_t b;
-        stream.read(reinterpret_cast<char*>(&b), 1);
-        return b;
+        if (cur >= end) {
+            throw std::runtime_error("Truncated DIET data");
+        }
+        return *cur++;
     }
 };
 
@@ -103,32 +263,71 @@ public:
 // ============================================================================
 
 class TtfHuffmanReader {
+    // Codes up to TABLE_BITS long resolve with a single table probe; longer
+    // ones continue bit by bit from the node the table stopped at.
+    static const int TABLE_BITS = 10;
+    
+    struct TableEntry {
+        uint16_t value = 0;   // Symbol for leaves, child pair index otherwise
+        uint8_t length = 0;   // Bits consumed, 0 if the prefix is invalid
+        bool leaf = false;
+    };
+    
     std::vector<uint16_t> huffman_tree;
+    std::vector<TableEntry> table;
     BitReader bit_reader;
     
-    bool is_parent_node(uint16_t node) {
+    static bool is_parent_node(uint16_t node) {
         return (node & 0x8000) == 0;
     }
     
-public:
-    TtfHuffmanReader(std::istream& s) : bit_reader(s) {
-        uint16_t tree_size_bytes;
-        s.read(reinterpret_cast<char*>(&tree_size_bytes), 2);
-        int tree_size = tree_size_bytes >> 1;
-        
-        huffman_tree.resize(tree_size);
-        for (int i = 0; i < tree_size; i++) {
-            uint16_t node;
-            s.read(reinterpret_cast<char*>(&node), 2);
-            huffman_tree[i] = is_parent_node(node) ? (node >> 1) : node;
+    static const uint8_t* skip_tree(const uint8_t* begin, const uint8_t* end) {
+        if (end - begin < 2) {
+            throw std::runtime_error("Truncated Huffman tree");
+        }
+        size_t tree_size_bytes = read_le16(begin) & ~1u;
+        if (static_cast<size_t>(end - begin - 2) < tree_size_bytes) {
+            throw std::runtime_error("Truncated Huffman tree");
         }
+        return begin + 2 + tree_size_bytes;
     }
     
-    int read_codeword() {
-        int node_idx = 0;
+    void build_table(size_t pair_idx, int depth, uint32_t prefix) {
+        if (pair_idx + 1 >= huffman_tree.size()) {
+            return;  // Leave the range marked invalid; decoding it throws
+        }
+        for (int side = 0; side < 2; side++) {
+            uint16_t node = huffman_tree[pair_idx + side];
+            uint32_t code = (prefix << 1) | side;
+            int len = depth + 1;
+            
+            if (!is_parent_node(node)) {
+                int span_bits = TABLE_BITS - len;
+                uint32_t first_entry = code << span_bits;
+                for (uint32_t i = 0; i < (1u << span_bits); i++) {
+                    TableEntry& e = table[first_entry + i];
+                    e.value = node & 0x7FFF;
+                    e.length = static_cast<uint8_t>(len);
+                    e.leaf = true;
+                }
+            } else if (len == TABLE_BITS) {
+                TableEntry& e = table[code];
+                e.value = node;
+                e.length = static_cast<uint8_t>(len);
+            } else {
+                build_table(node, len, code);
+            }
+        }
+    }
+    
+    int walk_tree(size_t node_idx) {
         while (!bit_reader.is_eof()) {
-            bool choose_first = !bit_reader.read_bit(true);
-            uint16_t current_node = huffman_tree[choose_first ? node_idx : node_idx + 1];
+            bool choose_first = !bit_reader.read_bit();
+            size_t next_idx = choose_first ? node_idx : node_idx + 1;
+            if (next_idx >= huffman_tree.size()) {
+                throw std::runtime_error("Invalid Huffman tree");
+            }
+            uint16_t current_node = huffman_tree[next_idx];
             if (is_parent_node(current_node)) {
                 node_idx = current_node;
             } else {
@@ -137,113 +336,274 @@ public:
         }
         return -1;
     }
+    
+public:
+    TtfHuffmanReader(const uint8_t* begin, const uint8_t* end)
+        : bit_reader(skip_tree(begin, end), end) {
+        int tree_size = read_le16(begin) >> 1;
+        
+        huffman_tree.resize(tree_size);
+        for (int i = 0; i < tree_size; i++) {
+            uint16_t node = read_le16(begin + 2 + i * 2);
+            huffman_tree[i] = is_parent_node(node) ? (node >> 1) : node;
+        }
+        
+        table.resize(1u << TABLE_BITS);
+        build_table(0, 0, 0);
+    }
+    
+    // Size of the tree section that precedes the bit stream
+    static size_t tree_bytes(const uint8_t* begin) {
+        return 2 + (read_le16(begin) & ~1u);
+    }
+    
+    // Longest code in the tree, or -1 if it is deeper than max_len or is
+    // not a proper tree (shared or cyclic subtrees)
+    int max_code_length(int max_len) const {
+        std::vector<std::pair<size_t, int>> pending = {{0, 1}};
+        size_t visits = 0;
+        int longest = 0;
+        while (!pending.empty()) {
+            if (++visits > huffman_tree.size()) return -1;
+            size_t pair_idx = pending.back().first;
+            int len = pending.back().second;
+            pending.pop_back();
+            if (len > max_len) return -1;
+            if (pair_idx + 1 >= huffman_tree.size()) continue;
+            
+            for (int side = 0; side < 2; side++) {
+                uint16_t node = huffman_tree[pair_idx + side];
+                if (is_parent_node(node)) {
+                    pending.push_back({node, len + 1});
+                } else if (len > longest) {
+                    longest = len;
+                }
+            }
+        }
+        return longest;
+    }
+    
+    const uint8_t* position() const { return bit_reader.position(); }
+    size_t remaining() const { return bit_reader.remaining(); }
+    void reseat(const uint8_t* new_cur, const uint8_t* new_end) {
+        bit_reader.reseat(new_cur, new_end);
+    }
+    
+    int read_codeword() {
+        int available = bit_reader.ensure_bits(TABLE_BITS);
+        if (available == 0) {
+            return -1;
+        }
+        
+        const TableEntry& e = table[bit_reader.peek_bits(TABLE_BITS)];
+        if (e.length != 0 && e.length <= available) {
+            bit_reader.skip_bits(e.length);
+            if (e.leaf) {
+                return e.value;
+            }
+            return walk_tree(e.value);
+        }
+        
+        // Invalid prefix or a code cut short by the end of input
+        return walk_tree(0);
+    }
 };
 
 // ============================================================================
 // LZW Decompression
 // ============================================================================
 
-static void decode_lzw(std::istream& input, std::vector<uint8_t>& output, bool alt_lzw = false) {
-    int code_clear = alt_lzw ? 0x101 : 0x100;
-    int code_end = alt_lzw ? 0x100 : 0x101;
-    const int dict_size_initial = 0x102;
-    const int dict_limit = 0x1000;
+// Dictionary and code width state of a TTF LZW stream. Each entry is its
+// prefix code plus one suffix byte. Strings are never materialized; they
+// are written by walking the prefix chain backwards into the output.
+// Codes below 256 are the single-byte roots and are never stored.
+class LzwDictionary {
+    static const int DICT_SIZE_INITIAL = 0x102;
+    static const int DICT_LIMIT = 0x1000;
+    
+    const int code_clear;
+    const int code_end;
+    
+    uint16_t prefix[DICT_LIMIT];
+    uint8_t suffix[DICT_LIMIT];
+    uint8_t first[DICT_LIMIT];
+    uint16_t length[DICT_LIMIT];
     
     int nbit = 9;
-    int dictsize = dict_size_initial;
+    int dictsize = DICT_SIZE_INITIAL;
+    int prev;
     
-    std::unordered_map<int, std::vector<uint8_t>> dict;
-    for (int i = 0; i < 256; i++) {
-        dict[i] = {static_cast<uint8_t>(i)};
-    }
+public:
+    static const int NO_OUTPUT = -1;    // Clear code
+    static const int END_OF_DATA = -2;  // End code
     
-    LzwCodeWordReader cw_reader(input);
+    explicit LzwDictionary(bool alt_lzw)
+        : code_clear(alt_lzw ? 0x101 : 0x100), code_end(alt_lzw ? 0x100 : 0x101), prev(code_clear) {
+        for (int i = 0; i < 256; i++) {
+            suffix[i] = static_cast<uint8_t>(i);
+            first[i] = static_cast<uint8_t>(i);
+            length[i] = 1;
+        }
+    }
     
-    int prev = code_clear;
-    while (prev != code_end) {
+    // Read one code and update the dictionary. Returns the code whose
+    // string comes next in the output, NO_OUTPUT or END_OF_DATA.
+    int next_code(LzwCodeWordReader& reader) {
+        if (prev == code_end) {
+            return END_OF_DATA;
+        }
         if (prev == code_clear) {
             nbit = 9;
-            dictsize = dict_size_initial;
-            dict.clear();
-            for (int i = 0; i < 256; i++) {
-                dict[i] = {static_cast<uint8_t>(i)};
-            }
+            dictsize = DICT_SIZE_INITIAL;
         }
         
-        int cw = cw_reader.read_codeword(nbit);
-        if (cw != code_end && cw != code_clear) {
-            uint8_t newbyte;
-            if (cw < dictsize) {
-                newbyte = dict[cw][0];
-            } else {
-                if (prev == code_clear || dictsize >= dict_limit || cw != dictsize) {
-                    throw std::runtime_error("Invalid LZW data");
-                }
-                newbyte = dict[prev][0];
+        int cw = reader.read_codeword(nbit);
+        if (cw == code_end || cw == code_clear) {
+            prev = cw;
+            return cw == code_end ? END_OF_DATA : NO_OUTPUT;
+        }
+        
+        uint8_t newbyte;
+        if (cw < dictsize) {
+            newbyte = first[cw];
+        } else {
+            if (prev == code_clear || dictsize >= DICT_LIMIT || cw != dictsize) {
+                throw std::runtime_error("Invalid LZW data");
             }
+            newbyte = first[prev];
+        }
+        
+        if ((prev != code_clear) && (dictsize < DICT_LIMIT)) {
+            prefix[dictsize] = static_cast<uint16_t>(prev);
+            suffix[dictsize] = newbyte;
+            first[dictsize] = first[prev];
+            length[dictsize] = static_cast<uint16_t>(length[prev] + 1);
+            dictsize++;
             
-            if ((prev != code_clear) && (dictsize < dict_limit)) {
-                std::vector<uint8_t> new_entry = dict[prev];
-                new_entry.push_back(newbyte);
-                dict[dictsize] = new_entry;
-                dictsize++;
-                
-                int max_dict_size = 1 << nbit;
-                if (dictsize == max_dict_size && nbit < 12) {
-                    nbit++;
-                }
+            int max_dict_size = 1 << nbit;
+            if (dictsize == max_dict_size && nbit < 12) {
+                nbit++;
             }
-            
-            const auto& out_data = dict[cw];
-            output.insert(output.end(), out_data.begin(), out_data.end());
         }
+        
         prev = cw;
+        return cw;
+    }
+    
+    size_t string_length(int code) const {
+        return length[code];
+    }
+    
+    // Write the string for code so that it ends just before dst_end
+    void write_string(int code, uint8_t* dst_end) const {
+        while (code >= 256) {
+            *--dst_end = suffix[code];
+            code = prefix[code];
+        }
+        *--dst_end = static_cast<uint8_t>(code);
+    }
+};
+
+// Longest string an LZW code can expand to
+static const size_t LZW_MAX_STRING = 0x1000;
+
+// Decode into out, which holds payload_size bytes. Returns the number of
+// bytes produced.
+static size_t decode_lzw(const uint8_t* begin, const uint8_t* end, uint8_t* out, size_t payload_size,
+                         bool alt_lzw = false) {
+    LzwDictionary dict(alt_lzw);
+    LzwCodeWordReader cw_reader(begin, end);
+    
+    size_t idx = 0;
+    for (;;) {
+        int code = dict.next_code(cw_reader);
+        if (code == LzwDictionary::END_OF_DATA) break;
+        if (code == LzwDictionary::NO_OUTPUT) continue;
+        
+        size_t len = dict.string_length(code);
+        if (len > payload_size - idx) {
+            throw std::runtime_error("LZW data exceeds payload size");
+        }
+        idx += len;
+        dict.write_string(code, out + idx);
     }
+    return idx;
 }
 
 // ============================================================================
 // Huffman RLE Decompression
 // ============================================================================
 
-static void decode_huffman_rle(std::istream& input, std::vector<uint8_t>& output) {
-    TtfHuffmanReader huffman_reader(input);
+// A literal byte, or a run repeating the last literal count times
+struct RleToken {
+    bool literal;
+    uint8_t value;
+    size_t count;
+};
+
+// Returns false once the input is exhausted
+static bool read_rle_token(TtfHuffmanReader& reader, RleToken& token) {
+    int cw = reader.read_codeword();
+    if (cw == -1) return false;
+    
+    int lo = cw & 0x00FF;
+    int hi = cw & 0xFF00;
     
+    if (hi == 0) {
+        token.literal = true;
+        token.value = static_cast<uint8_t>(lo);
+        return true;
+    }
+    
+    token.literal = false;
+    switch (lo) {
+        case 0:
+            cw = reader.read_codeword();
+            if (cw == -1) return false;
+            token.count = cw;
+            break;
+        case 1: {
+            cw = reader.read_codeword();
+            if (cw == -1) return false;
+            int count_hi = cw & 0xFF;
+            cw = reader.read_codeword();
+            if (cw == -1) return false;
+            int count_lo = cw & 0xFF;
+            token.count = (count_hi << 8) | count_lo;
+            break;
+        }
+        default:
+            token.count = lo;
+            break;
+    }
+    return true;
+}
+
+// Decode into out, which holds payload_size bytes. Returns the number of
+// bytes produced, which is short of payload_size for truncated input.
+static size_t decode_huffman_rle(const uint8_t* begin, const uint8_t* end, uint8_t* out,
+                                 size_t payload_size) {
+    TtfHuffmanReader huffman_reader(begin, end);
+    
+    size_t idx = 0;
     uint8_t last = 0;
-    int cw;
-    while ((cw = huffman_reader.read_codeword()) != -1) {
-        int lo = cw & 0x00FF;
-        int hi = cw & 0xFF00;
-        
-        if (hi == 0) {
-            last = static_cast<uint8_t>(lo);
-            output.push_back(last);
+    RleToken token;
+    while (idx < payload_size && read_rle_token(huffman_reader, token)) {
+        if (token.literal) {
+            last = token.value;
+            out[idx++] = last;
         } else {
-            int count = 0;
-            switch (lo) {
-                case 0:
-                    cw = huffman_reader.read_codeword();
-                    if (cw == -1) return;
-                    count = cw;
-                    break;
-                case 1: {
-                    cw = huffman_reader.read_codeword();
-                    if (cw == -1) return;
-                    int count_hi = cw & 0xFF;
-                    cw = huffman_reader.read_codeword();
-                    if (cw == -1) return;
-                    int count_lo = cw & 0xFF;
-                    count = (count_hi << 8) | count_lo;
-                    break;
-                }
-                default:
-                    count = lo;
-                    break;
-            }
-            for (int i = 0; i < count; i++) {
-                output.push_back(last);
+            // Padding bits in the final byte can decode as spurious symbols
+            size_t count = token.count;
+            if (count > payload_size - idx) {
+                count = payload_size - idx;
             }
+            memset(out + idx, last, count);
+            idx += count;
         }
     }
+    
+    return idx;
 }
 
 // ============================================================================
@@ -288,104 +648,577 @@ static int read_repeat_count_varlen(DietBitReader& reader) {
     }
 }
 
-static void decode_diet(std::istream& input, std::vector<uint8_t>& output, size_t payload_size) {
-    output.resize(payload_size);
-    DietBitReader bit_reader(input);
+// Copy a back-reference of count bytes from distance bytes behind dst.
+// Whole blocks are copied when the source cannot overlap the block being
+// written and the destination has room for the rounded-up length.
+static void copy_match(uint8_t* dst, size_t distance, size_t count, size_t room) {
+    const uint8_t* src = dst - distance;
+    
+    if (distance >= 16 && ((count + 15) & ~size_t(15)) <= room) {
+        for (size_t i = 0; i < count; i += 16) {
+            memcpy(dst + i, src + i, 16);
+        }
+    } else if (distance >= 8 && ((count + 7) & ~size_t(7)) <= room) {
+        for (size_t i = 0; i < count; i += 8) {
+            memcpy(dst + i, src + i, 8);
+        }
+    } else if (distance == 1) {
+        memset(dst, src[0], count);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+// Back-reference following a 0 flag bit
+struct DietMatch {
+    size_t distance;
+    size_t count;
+};
+
+// Returns false on the end-of-data marker
+static bool read_diet_match(DietBitReader& reader, DietMatch& match) {
+    bool bit = reader.read_bit();
+    uint8_t off_lo = reader.read_next_byte();
+    uint8_t off_hi;
+    
+    if (!bit) {
+        if (reader.read_bit()) {
+            off_hi = (0xF8 | reader.read_3bit_value()) - 1;
+        } else {
+            off_hi = 0xFF;
+            if (off_lo == 0xFF) return false;
+        }
+        match.count = 2;
+    } else {
+        off_hi = read_hi_byte_varlen(reader);
+        match.count = 2 + read_repeat_count_varlen(reader);
+    }
+    
+    // Both encodings only produce negative offsets (-8192..-1)
+    int16_t offset = static_cast<int16_t>((off_hi << 8) | off_lo);
+    if (offset >= 0) {
+        throw std::runtime_error("Invalid DIET back-reference");
+    }
+    match.distance = static_cast<size_t>(-static_cast<int>(offset));
+    return true;
+}
+
+// Furthest back a DIET match can reach
+static const size_t DIET_MAX_DISTANCE = 0x2000;
+
+// Decode into out, which must hold payload_size bytes and may have extra
+// capacity for block copies. Returns the number of bytes produced.
+static size_t decode_diet(const uint8_t* begin, const uint8_t* end, uint8_t* out,
+                          size_t payload_size, size_t capacity) {
+    DietBitReader bit_reader(begin, end);
     
     size_t idx = 0;
+    DietMatch match;
     while (idx < payload_size) {
         while (bit_reader.read_bit()) {
-            output[idx++] = bit_reader.read_next_byte();
-            if (idx >= payload_size) return;
+            out[idx++] = bit_reader.read_next_byte();
+            if (idx >= payload_size) return idx;
         }
         
-        bool bit = bit_reader.read_bit();
-        uint8_t off_lo = bit_reader.read_next_byte();
-        uint8_t off_hi;
-        int repeat_count;
-        
-        if (!bit) {
-            if (bit_reader.read_bit()) {
-                off_hi = (0xF8 | bit_reader.read_3bit_value()) - 1;
-            } else {
-                off_hi = 0xFF;
-                if (off_lo == 0xFF) return;
-            }
-            repeat_count = 2;
-        } else {
-            off_hi = read_hi_byte_varlen(bit_reader);
-            repeat_count = 2 + read_repeat_count_varlen(bit_reader);
+        if (!read_diet_match(bit_reader, match)) return idx;
+        if (match.distance > idx) {
+            throw std::runtime_error("Invalid DIET back-reference");
         }
         
-        int16_t offset = static_cast<int16_t>((off_hi << 8) | off_lo);
-        size_t source_idx = idx + offset;
-        
-        for (int i = 0; i < repeat_count && idx < payload_size; i++) {
-            output[idx++] = output[source_idx++];
+        size_t count = match.count;
+        if (count > payload_size - idx) {
+            count = payload_size - idx;
         }
+        copy_match(out + idx, match.distance, count, capacity - idx);
+        idx += count;
     }
+    return idx;
 }
 
 // ============================================================================
 // Main Unpack Function
 // ============================================================================
 
-std::vector<uint8_t> unpack(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file: " + filename);
+// Extra bytes past the payload that decoders may touch with block copies
+static const size_t COPY_SLACK = 16;
+
+struct Header {
+    ArchiveInfo info;
+    size_t header_size;
+};
+
+static Header parse_header(const uint8_t* data, size_t size) {
+    if (size < 4) {
+        throw std::runtime_error("SQZ data too short");
     }
     
+    Header header;
+    
     // Check for DIET signature
-    uint16_t signature;
-    file.read(reinterpret_cast<char*>(&signature), 2);
-    file.seekg(0);
+    uint16_t signature = read_le16(data);
     
     if (signature == 0x4CB4) {
-        // DIET compressed
-        uint8_t diet_sig[9];
-        file.read(reinterpret_cast<char*>(diet_sig), 9);
-        
-        file.seekg(1, std::ios::cur); // skip b09
-        file.seekg(4, std::ios::cur); // skip checksum
-        
-        uint8_t size_hi_byte;
-        file.read(reinterpret_cast<char*>(&size_hi_byte), 1);
-        int payload_size_hi = (size_hi_byte >> 2) & 0x1F;
-        
-        uint16_t payload_size_lo;
-        file.read(reinterpret_cast<char*>(&payload_size_lo), 2);
-        
-        size_t payload_size = (payload_size_hi << 16) | payload_size_lo;
+        // DIET compressed: 9 byte signature, b09, 4 byte checksum, then size
+        if (size < 17) {
+            throw std::runtime_error("Truncated DIET header");
+        }
+        int payload_size_hi = (data[14] >> 2) & 0x1F;
+        uint16_t payload_size_lo = read_le16(data + 15);
         
-        std::vector<uint8_t> output;
-        decode_diet(file, output, payload_size);
-        return output;
+        header.info.format = Format::Diet;
+        header.info.payload_size = (payload_size_hi << 16) | payload_size_lo;
+        header.header_size = 17;
     } else {
         // TTF format - LZW or Huffman
-        uint8_t first_byte;
-        file.read(reinterpret_cast<char*>(&first_byte), 1);
-        int payload_size_hi = first_byte & 0x0F;
+        int payload_size_hi = data[0] & 0x0F;
+        uint8_t type = data[1];
+        uint16_t payload_size_lo = read_le16(data + 2);
         
-        uint8_t type;
-        file.read(reinterpret_cast<char*>(&type), 1);
+        header.info.format = (type == 0x10) ? Format::Lzw : Format::HuffmanRle;
+        header.info.payload_size = (payload_size_hi << 16) | payload_size_lo;
+        header.header_size = 4;
+    }
+    return header;
+}
+
+static size_t decode_payload(const uint8_t* data, size_t size, const Header& header,
+                             uint8_t* dst, size_t capacity) {
+    const uint8_t* begin = data + header.header_size;
+    const uint8_t* end = data + size;
+    size_t payload_size = header.info.payload_size;
+    
+    switch (header.info.format) {
+        case Format::Lzw:
+            return decode_lzw(begin, end, dst, payload_size);
+        case Format::HuffmanRle:
+            return decode_huffman_rle(begin, end, dst, payload_size);
+        case Format::Diet: {
+            size_t produced = decode_diet(begin, end, dst, payload_size, capacity);
+            // An early end marker leaves the rest of the payload zeroed
+            if (produced < payload_size) {
+                memset(dst + produced, 0, payload_size - produced);
+            }
+            return payload_size;
+        }
+    }
+    return 0;
+}
+
+ArchiveInfo probe(const uint8_t* data, size_t size) {
+    return parse_header(data, size).info;
+}
+
+ArchiveInfo probe(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + filename);
+    }
+    
+    uint8_t header[17];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    return probe(header, static_cast<size_t>(file.gcount()));
+}
+
+size_t unpack_into(const uint8_t* data, size_t size, uint8_t* dst, size_t capacity) {
+    Header header = parse_header(data, size);
+    if (capacity < header.info.payload_size) {
+        throw std::runtime_error("Destination buffer too small");
+    }
+    return decode_payload(data, size, header, dst, capacity);
+}
+
+size_t unpack_into(const std::string& filename, uint8_t* dst, size_t capacity) {
+    MappedFile file(filename);
+    return unpack_into(file.data(), file.size(), dst, capacity);
+}
+
+std::vector<uint8_t> unpack(const uint8_t* data, size_t size) {
+    Header header = parse_header(data, size);
+    
+    std::vector<uint8_t> output(header.info.payload_size + COPY_SLACK);
+    size_t produced = decode_payload(data, size, header, output.data(), output.size());
+    output.resize(produced);
+    return output;
+}
+
+std::vector<uint8_t> unpack(const std::string& filename) {
+    MappedFile file(filename);
+    return unpack(file.data(), file.size());
+}
+
+std::vector<uint8_t> unpack_alt_lzw(const uint8_t* data, size_t size) {
+    Header header = parse_header(data, size);
+    if (header.info.format != Format::Lzw) {
+        throw std::runtime_error("Not an LZW archive");
+    }
+    
+    std::vector<uint8_t> output(header.info.payload_size + COPY_SLACK);
+    size_t produced = decode_lzw(data + header.header_size, data + size, output.data(),
+                                 header.info.payload_size, true);
+    output.resize(produced);
+    return output;
+}
+
+// ============================================================================
+// Streaming Decoder
+// ============================================================================
+
+// The decoders run one token at a time into a sliding output window. A token
+// is only decoded once enough input is buffered for its worst case, so the
+// readers never reach the end of a partial input; after finish() they see
+// the real end of data.
+struct StreamDecoder::Impl {
+    static constexpr size_t HISTORY = DIET_MAX_DISTANCE;
+    static constexpr size_t WINDOW_SIZE = HISTORY + 0x8000;
+    static constexpr size_t MAX_TOKEN = LZW_MAX_STRING;
+    static constexpr size_t COMPACT_THRESHOLD = 0x10000;
+    
+    // Worst-case input consumed by one token: an LZW code is at most 12 bits;
+    // a DIET match is at most 19 flag bits (two word fetches, plus one eager
+    // fetch at the end) and two bytes
+    static constexpr size_t LZW_MARGIN = 2;
+    static constexpr size_t DIET_MARGIN = 8;
+    
+    bool alt_lzw = false;  // Clear and end codes swapped, as in unpack_alt_lzw
+    std::vector<uint8_t> input;
+    bool input_finished = false;
+    bool header_parsed = false;
+    bool end_of_data = false;
+    Header header = {};
+    size_t margin = 0;
+    
+    std::unique_ptr<LzwDictionary> lzw_dict;
+    std::unique_ptr<LzwCodeWordReader> lzw_reader;
+    std::unique_ptr<TtfHuffmanReader> huffman_reader;
+    std::unique_ptr<DietBitReader> diet_reader;
+    
+    std::vector<uint8_t> window = std::vector<uint8_t>(WINDOW_SIZE);
+    size_t wpos = 0;          // End of decoded data in window
+    size_t rpos = 0;          // End of data already pulled
+    size_t produced = 0;      // Total bytes decoded
+    
+    // Output still owed by the current token: a copy from pending_distance
+    // bytes back, or a fill with pending_value when the distance is zero
+    size_t pending_count = 0;
+    size_t pending_distance = 0;
+    uint8_t pending_value = 0;
+    uint8_t last_literal = 0;  // Huffman-RLE run byte
+    
+    const uint8_t* input_position() const {
+        switch (header.info.format) {
+            case Format::Lzw: return lzw_reader->position();
+            case Format::HuffmanRle: return huffman_reader->position();
+            case Format::Diet: return diet_reader->position();
+        }
+        return nullptr;
+    }
+    
+    void reseat_readers(const uint8_t* cur) {
+        const uint8_t* end = input.data() + input.size();
+        switch (header.info.format) {
+            case Format::Lzw: lzw_reader->reseat(cur, end); break;
+            case Format::HuffmanRle: huffman_reader->reseat(cur, end); break;
+            case Format::Diet: diet_reader->reseat(cur, end); break;
+        }
+    }
+    
+    void feed(const uint8_t* data, size_t size) {
+        if (!header_parsed) {
+            input.insert(input.end(), data, data + size);
+            return;
+        }
         
-        uint16_t payload_size_lo;
-        file.read(reinterpret_cast<char*>(&payload_size_lo), 2);
+        // Drop consumed input before growing the buffer
+        size_t offset = static_cast<size_t>(input_position() - input.data());
+        if (offset >= COMPACT_THRESHOLD) {
+            input.erase(input.begin(), input.begin() + offset);
+            offset = 0;
+        }
+        input.insert(input.end(), data, data + size);
+        reseat_readers(input.data() + offset);
+    }
+    
+    bool start() {
+        if (input.size() < 4 || (read_le16(input.data()) == 0x4CB4 && input.size() < 17)) {
+            if (input_finished) parse_header(input.data(), input.size());  // Throws
+            return false;
+        }
         
-        size_t payload_size = (payload_size_hi << 16) | payload_size_lo;
+        header = parse_header(input.data(), input.size());
+        const uint8_t* begin = input.data() + header.header_size;
+        const uint8_t* end = input.data() + input.size();
         
-        std::vector<uint8_t> output;
-        output.reserve(payload_size);
+        switch (header.info.format) {
+            case Format::Lzw:
+                lzw_dict.reset(new LzwDictionary(alt_lzw));
+                lzw_reader.reset(new LzwCodeWordReader(begin, end));
+                margin = LZW_MARGIN;
+                break;
+            case Format::HuffmanRle: {
+                if (end - begin < 2 || static_cast<size_t>(end - begin) < TtfHuffmanReader::tree_bytes(begin)) {
+                    if (input_finished) {
+                        throw std::runtime_error("Truncated Huffman tree");
+                    }
+                    return false;
+                }
+                huffman_reader.reset(new TtfHuffmanReader(begin, end));
+                // A token is up to three codewords; without a usable bound
+                // decoding waits for the whole input
+                int max_len = huffman_reader->max_code_length(64);
+                margin = max_len < 0 ? SIZE_MAX : static_cast<size_t>(3 * max_len + 7) / 8 + 1;
+                break;
+            }
+            case Format::Diet:
+                // The reader fetches its first word on construction
+                if (end - begin < static_cast<ptrdiff_t>(DIET_MARGIN) && !input_finished) {
+                    return false;
+                }
+                diet_reader.reset(new DietBitReader(begin, end));
+                margin = DIET_MARGIN;
+                break;
+        }
         
-        if (type == 0x10) {
-            decode_lzw(file, output);
+        header_parsed = true;
+        return true;
+    }
+    
+    size_t remaining_input() const {
+        switch (header.info.format) {
+            case Format::Lzw: return lzw_reader->remaining();
+            case Format::HuffmanRle: return huffman_reader->remaining();
+            case Format::Diet: return diet_reader->remaining();
+        }
+        return 0;
+    }
+    
+    bool done() const {
+        return header_parsed && end_of_data && pending_count == 0;
+    }
+    
+    void emit_pending() {
+        size_t count = std::min(pending_count, window.size() - wpos);
+        if (pending_distance == 0) {
+            memset(window.data() + wpos, pending_value, count);
         } else {
-            decode_huffman_rle(file, output);
+            copy_match(window.data() + wpos, pending_distance, count, window.size() - wpos);
+        }
+        wpos += count;
+        produced += count;
+        pending_count -= count;
+    }
+    
+    // Queue a fill or copy of count bytes, clipped to the payload size
+    void queue(size_t count, size_t distance, uint8_t value) {
+        pending_count = std::min(count, header.info.payload_size - produced);
+        pending_distance = distance;
+        pending_value = value;
+    }
+    
+    void decode_token() {
+        switch (header.info.format) {
+            case Format::Lzw: {
+                int code = lzw_dict->next_code(*lzw_reader);
+                if (code == LzwDictionary::END_OF_DATA) {
+                    end_of_data = true;
+                } else if (code != LzwDictionary::NO_OUTPUT) {
+                    size_t len = lzw_dict->string_length(code);
+                    if (len > header.info.payload_size - produced) {
+                        throw std::runtime_error("LZW data exceeds payload size");
+                    }
+                    wpos += len;
+                    produced += len;
+                    lzw_dict->write_string(code, window.data() + wpos);
+                }
+                break;
+            }
+            case Format::HuffmanRle: {
+                RleToken token;
+                if (produced >= header.info.payload_size || !read_rle_token(*huffman_reader, token)) {
+                    end_of_data = true;
+                } else if (token.literal) {
+                    last_literal = token.value;
+                    window[wpos++] = token.value;
+                    produced++;
+                } else {
+                    queue(token.count, 0, last_literal);
+                }
+                break;
+            }
+            case Format::Diet: {
+                DietMatch match;
+                if (produced >= header.info.payload_size) {
+                    end_of_data = true;
+                } else if (diet_reader->read_bit()) {
+                    window[wpos++] = diet_reader->read_next_byte();
+                    produced++;
+                } else if (!read_diet_match(*diet_reader, match)) {
+                    // An early end marker leaves the rest of the payload zeroed
+                    queue(header.info.payload_size - produced, 0, 0);
+                    end_of_data = true;
+                } else {
+                    if (match.distance > produced) {
+                        throw std::runtime_error("Invalid DIET back-reference");
+                    }
+                    queue(match.count, match.distance, 0);
+                }
+                break;
+            }
+        }
+    }
+    
+    // Decode more output into the window. Returns false if nothing could
+    // be decoded because more input is needed or the stream is done.
+    bool step() {
+        if (!header_parsed && !start()) return false;
+        if (done()) return false;
+        
+        // Slide the window, keeping the history DIET matches can reach
+        if (window.size() - wpos < MAX_TOKEN) {
+            size_t keep = std::min(wpos, HISTORY);
+            memmove(window.data(), window.data() + wpos - keep, keep);
+            wpos = rpos = keep;
         }
         
-        return output;
+        if (pending_count > 0) {
+            emit_pending();
+            return true;
+        }
+        if (!input_finished && remaining_input() < margin) {
+            return false;
+        }
+        decode_token();
+        return true;
+    }
+};
+
+StreamDecoder::StreamDecoder(bool alt_lzw) : impl(new Impl) {
+    impl->alt_lzw = alt_lzw;
+}
+
+StreamDecoder::~StreamDecoder() = default;
+
+void StreamDecoder::feed(const uint8_t* data, size_t size) {
+    if (impl->input_finished) {
+        throw std::runtime_error("SQZ stream already finished");
+    }
+    impl->feed(data, size);
+}
+
+void StreamDecoder::finish() {
+    impl->input_finished = true;
+}
+
+size_t StreamDecoder::pull(uint8_t* dst, size_t max_size) {
+    size_t written = 0;
+    while (written < max_size) {
+        if (impl->rpos < impl->wpos) {
+            size_t count = std::min(impl->wpos - impl->rpos, max_size - written);
+            memcpy(dst + written, impl->window.data() + impl->rpos, count);
+            impl->rpos += count;
+            written += count;
+        } else if (!impl->step()) {
+            break;
+        }
+    }
+    return written;
+}
+
+bool StreamDecoder::header_ready() const {
+    return impl->header_parsed;
+}
+
+ArchiveInfo StreamDecoder::info() const {
+    return impl->header.info;
+}
+
+bool StreamDecoder::done() const {
+    return impl->done() && impl->rpos == impl->wpos;
+}
+
+size_t StreamDecoder::produced() const {
+    return impl->produced;
+}
+
+void unpack_chunked(const uint8_t* data, size_t size, size_t chunk_size, const ChunkCallback& on_chunk) {
+    const size_t feed_size = 0x10000;
+    
+    StreamDecoder decoder;
+    std::vector<uint8_t> chunk(chunk_size);
+    size_t fed = 0;
+    bool finished = false;
+    
+    for (;;) {
+        size_t count = decoder.pull(chunk.data(), chunk.size());
+        if (count > 0) {
+            on_chunk(chunk.data(), count);
+            continue;
+        }
+        if (finished) break;
+        
+        size_t n = std::min(feed_size, size - fed);
+        decoder.feed(data + fed, n);
+        fed += n;
+        if (fed == size) {
+            decoder.finish();
+            finished = true;
+        }
+    }
+}
+
+void unpack_chunked(const std::string& filename, size_t chunk_size, const ChunkCallback& on_chunk) {
+    MappedFile file(filename);
+    unpack_chunked(file.data(), file.size(), chunk_size, on_chunk);
+}
+
+// ============================================================================
+// Batch Unpacking
+// ============================================================================
+
+bool is_archive_name(const std::string& filename) {
+    std::string ext = std::filesystem::path(filename).extension().string();
+    for (char& c : ext) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return ext == ".SQZ" || ext == ".TRK";
+}
+
+static UnpackResult unpack_timed(const std::string& filename) {
+    UnpackResult result;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        MappedFile file(filename);
+        result.info = probe(file.data(), file.size());
+        result.data = unpack(file.data(), file.size());
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.milliseconds = std::chrono::duration<double, std::milli>(elapsed).count();
+    return result;
+}
+
+std::map<std::string, UnpackResult> unpack_all(const std::string& dir, unsigned threads) {
+    std::vector<std::string> names;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file() && is_archive_name(entry.path().string())) {
+            names.push_back(entry.path().filename().string());
+        }
+    }
+    
+    util::ThreadPool pool(threads);
+    std::vector<std::future<UnpackResult>> pending;
+    for (const auto& name : names) {
+        std::string filename = dir + "/" + name;
+        pending.push_back(pool.submit([filename]() { return unpack_timed(filename); }));
+    }
+    
+    std::map<std::string, UnpackResult> results;
+    for (size_t i = 0; i < names.size(); i++) {
+        results[names[i]] = pending[i].get();
     }
+    return results;
 }
 
 } // namespace sqz
@@ -3,10 +3,117 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
 
 namespace sqz {
 
+// Read-only view of a whole file, memory-mapped where the platform allows
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return ptr; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* ptr = nullptr;
+    size_t length = 0;
+    std::vector<uint8_t> fallback;  // Used where mmap is unavailable
+};
+
+// Compression scheme of an SQZ archive
+enum class Format {
+    Lzw,         // TTF LZW (type 0x10)
+    HuffmanRle,  // TTF Huffman + RLE
+    Diet         // DIET
+};
+
+// Archive header contents
+struct ArchiveInfo {
+    Format format = Format::Lzw;
+    size_t payload_size = 0;  // Decompressed size in bytes
+};
+
+// Parse only the archive header
+ArchiveInfo probe(const std::string& filename);
+ArchiveInfo probe(const uint8_t* data, size_t size);
+
+// Unpack into a caller-owned buffer of at least payload_size bytes.
+// Returns the number of bytes written; throws if capacity is too small.
+size_t unpack_into(const std::string& filename, uint8_t* dst, size_t capacity);
+size_t unpack_into(const uint8_t* data, size_t size, uint8_t* dst, size_t capacity);
+
 // Unpack an SQZ file, returns decompressed data
 std::vector<uint8_t> unpack(const std::string& filename);
 
+// Unpack an SQZ archive already held in memory
+std::vector<uint8_t> unpack(const uint8_t* data, size_t size);
+
+// Unpack an LZW archive that swaps the clear (0x101) and end (0x100) codes.
+// The header does not record the ordering, so the caller must know it.
+std::vector<uint8_t> unpack_alt_lzw(const uint8_t* data, size_t size);
+
+// Incremental decoder for all three formats. Compressed input is fed as it
+// arrives and decoded output is pulled in chunks of any size; only a small
+// output window and the unconsumed input are kept in memory. alt_lzw selects
+// the swapped LZW code order of unpack_alt_lzw; other formats ignore it.
+class StreamDecoder {
+public:
+    explicit StreamDecoder(bool alt_lzw = false);
+    ~StreamDecoder();
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    // Append compressed input
+    void feed(const uint8_t* data, size_t size);
+
+    // Signal that no more input will be fed
+    void finish();
+
+    // Decode up to max_size bytes into dst. Returns the number of bytes
+    // written; 0 means more input is needed or the stream is done.
+    size_t pull(uint8_t* dst, size_t max_size);
+
+    // Header info is valid once header_ready() returns true
+    bool header_ready() const;
+    ArchiveInfo info() const;
+
+    bool done() const;
+    size_t produced() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Called with each decoded chunk, in order
+using ChunkCallback = std::function<void(const uint8_t* data, size_t size)>;
+
+// Unpack in chunks of at most chunk_size bytes
+void unpack_chunked(const std::string& filename, size_t chunk_size, const ChunkCallback& on_chunk);
+void unpack_chunked(const uint8_t* data, size_t size, size_t chunk_size, const ChunkCallback& on_chunk);
+
+// True for the archive extensions the game uses (.SQZ, .TRK, any case)
+bool is_archive_name(const std::string& filename);
+
+// Outcome of unpacking one file in a batch
+struct UnpackResult {
+    ArchiveInfo info;
+    std::vector<uint8_t> data;
+    double milliseconds = 0;  // Wall time spent decoding this file
+    std::string error;        // Empty on success
+};
+
+// Unpack every *.SQZ and *.TRK file in dir across a pool of worker threads
+// (threads == 0 uses all hardware threads). Results are keyed by file name.
+std::map<std::string, UnpackResult> unpack_all(const std::string& dir, unsigned threads = 0);
+
 } // namespace sqz
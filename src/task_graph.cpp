@@ -0,0 +1,125 @@
+#include "task_graph.h"
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+namespace util {
+
+TaskGraph::TaskId TaskGraph::add(const std::string& stage, const std::string& name,
+                                 std::function<void()> work, const std::vector<TaskId>& dependencies) {
+    TaskId id = tasks.size();
+    Task task;
+    task.stage = stage;
+    task.name = name;
+    task.work = std::move(work);
+    task.waiting = dependencies.size();
+    tasks.push_back(std::move(task));
+
+    for (TaskId dependency : dependencies) {
+        tasks.at(dependency).dependents.push_back(id);
+    }
+    return id;
+}
+
+TaskGraphReport TaskGraph::run(ThreadPool& pool, const Progress& progress) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::mutex mutex;
+    std::condition_variable all_done;
+    size_t done = 0;
+
+    // Record a finished (or skipped) task and collect dependents that are
+    // now ready. Called with the lock held.
+    std::function<void(TaskId, std::vector<TaskId>&)> complete =
+        [&](TaskId id, std::vector<TaskId>& ready) {
+            Task& task = tasks[id];
+            done++;
+            if (progress) progress(done, tasks.size(), task.name);
+
+            for (TaskId dependent_id : task.dependents) {
+                Task& dependent = tasks[dependent_id];
+                if (task.failed || task.blocked) dependent.blocked = true;
+                if (--dependent.waiting > 0) continue;
+
+                if (dependent.blocked) {
+                    complete(dependent_id, ready);
+                } else {
+                    ready.push_back(dependent_id);
+                }
+            }
+        };
+
+    std::function<void(TaskId)> launch = [&](TaskId id) {
+        pool.submit([&, id]() {
+            Task& task = tasks[id];
+            auto task_start = std::chrono::steady_clock::now();
+            try {
+                task.work();
+            } catch (const std::exception& e) {
+                task.failed = true;
+                task.error = e.what();
+            } catch (...) {
+                task.failed = true;
+                task.error = "unknown error";
+            }
+            task.ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - task_start).count();
+
+            std::vector<TaskId> ready;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                complete(id, ready);
+                if (done == tasks.size()) all_done.notify_all();
+            }
+            for (TaskId next : ready) launch(next);
+        });
+    };
+
+    // Tasks are only added before run(), so no worker touches the vector
+    // until the roots are launched
+    std::vector<TaskId> roots;
+    for (TaskId id = 0; id < tasks.size(); id++) {
+        if (tasks[id].waiting == 0) roots.push_back(id);
+    }
+    for (TaskId id : roots) launch(id);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_done.wait(lock, [&] { return done == tasks.size(); });
+    }
+
+    TaskGraphReport report;
+    report.tasks = tasks.size();
+    for (const Task& task : tasks) {
+        StageReport* stage = nullptr;
+        for (auto& existing : report.stages) {
+            if (existing.name == task.stage) stage = &existing;
+        }
+        if (!stage) {
+            report.stages.push_back(StageReport());
+            stage = &report.stages.back();
+            stage->name = task.stage;
+        }
+
+        stage->tasks++;
+        if (task.blocked) {
+            stage->skipped++;
+            report.skipped++;
+            continue;
+        }
+        if (task.failed) {
+            stage->failed++;
+            report.failed++;
+            report.errors.push_back(task.name + ": " + task.error);
+        }
+        stage->busy_ms += task.ms;
+        if (task.ms > stage->max_ms) stage->max_ms = task.ms;
+    }
+    report.wall_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    return report;
+}
+
+} // namespace util
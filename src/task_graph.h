@@ -0,0 +1,67 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace util {
+
+// Timings of all tasks sharing a stage name
+struct StageReport {
+    std::string name;
+    size_t tasks = 0;
+    size_t failed = 0;
+    size_t skipped = 0;   // Not run because a dependency failed
+    double busy_ms = 0;   // Summed over tasks
+    double max_ms = 0;    // Slowest task
+};
+
+struct TaskGraphReport {
+    std::vector<StageReport> stages;  // In order of first appearance
+    std::vector<std::string> errors;  // "task: message" for each failure
+    size_t tasks = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    double wall_ms = 0;
+};
+
+// Tasks with dependencies, run on a ThreadPool. A task is queued as soon as
+// everything it depends on has finished, so independent work overlaps
+// freely. When a task throws, the tasks depending on it are skipped and
+// the rest still run.
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+    // Called after each task with the number finished so far; calls are
+    // serialised but may come from any worker
+    using Progress = std::function<void(size_t done, size_t total, const std::string& task)>;
+
+    // Dependencies must already have been added
+    TaskId add(const std::string& stage, const std::string& name, std::function<void()> work,
+               const std::vector<TaskId>& dependencies = {});
+
+    size_t size() const { return tasks.size(); }
+
+    // Run every task and wait for all of them. A graph runs once.
+    TaskGraphReport run(ThreadPool& pool, const Progress& progress = nullptr);
+
+private:
+    struct Task {
+        std::string stage;
+        std::string name;
+        std::function<void()> work;
+        std::vector<TaskId> dependents;
+        size_t waiting = 0;     // Unfinished dependencies
+        bool blocked = false;   // A dependency failed or was skipped
+        bool failed = false;
+        double ms = 0;
+        std::string error;
+    };
+
+    std::vector<Task> tasks;
+};
+
+} // namespace util
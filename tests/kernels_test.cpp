@@ -0,0 +1,151 @@
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs every pixel kernel with each instruction set this CPU supports,
+// scalar included, and checks all of them against the same straightforward
+// reference. Sizes are odd and buffers start at unaligned offsets so both
+// the vector bodies and the scalar tails get exercised.
+//
+// Usage: kernels_test
+
+using kernels::Isa;
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+template <typename T>
+static void check_equal(const std::vector<T>& expected, const std::vector<T>& actual, const std::string& what) {
+    auto diff = std::mismatch(expected.begin(), expected.end(), actual.begin());
+    check(diff.first == expected.end(),
+          what + ": first difference at element " + std::to_string(diff.first - expected.begin()));
+}
+
+// Scalar first, then every wider ISA the CPU can run
+static std::vector<Isa> supported_isas() {
+    std::vector<Isa> isas;
+    for (Isa isa : {Isa::Scalar, Isa::Sse2, Isa::Avx2}) {
+        if (static_cast<int>(isa) <= static_cast<int>(kernels::detect_isa())) isas.push_back(isa);
+    }
+    return isas;
+}
+
+// ============================================================================
+// Planar to 8bpp
+// ============================================================================
+
+// Pixel p of plane position i takes bit 7 - p of each plane byte, plane 0
+// as the lowest bit of the index
+static std::vector<uint8_t> reference_planar(const uint8_t* src, size_t size) {
+    size_t plane_length = size / 4;
+    std::vector<uint8_t> dst(size * 2);
+    for (size_t i = 0; i < plane_length; i++) {
+        for (int p = 0; p < 8; p++) {
+            uint8_t index = 0;
+            for (int plane = 0; plane < 4; plane++) {
+                index |= ((src[plane_length * plane + i] >> (7 - p)) & 1) << plane;
+            }
+            dst[i * 8 + p] = index;
+        }
+    }
+    return dst;
+}
+
+static void test_planar(size_t size, size_t src_offset, size_t dst_offset, std::mt19937& rng) {
+    std::vector<uint8_t> src(src_offset + size);
+    for (auto& byte : src) byte = static_cast<uint8_t>(rng());
+    std::vector<uint8_t> expected = reference_planar(src.data() + src_offset, size);
+
+    for (Isa isa : supported_isas()) {
+        std::string what = "planar_to_indexed(" + std::string(kernels::isa_name(isa)) + ", size " +
+                           std::to_string(size) + ", offsets " + std::to_string(src_offset) + "/" +
+                           std::to_string(dst_offset) + ")";
+
+        // One guard byte past the end catches overruns
+        std::vector<uint8_t> dst(dst_offset + size * 2 + 1, 0xAA);
+        kernels::planar_to_indexed(src.data() + src_offset, size, dst.data() + dst_offset, isa);
+
+        check_equal(expected, std::vector<uint8_t>(dst.begin() + dst_offset, dst.end() - 1), what);
+        check(dst.back() == 0xAA, what + ": wrote past the end");
+    }
+}
+
+// ============================================================================
+// 8bpp to ARGB
+// ============================================================================
+
+static void test_argb(size_t count, size_t src_offset, size_t dst_offset, bool sparse, std::mt19937& rng) {
+    uint32_t lut[256];
+    for (auto& color : lut) color = rng();
+
+    // Sparse inputs are mostly index 0, as in tile layers
+    std::vector<uint8_t> src(src_offset + count);
+    for (auto& byte : src) byte = (sparse && rng() % 4 != 0) ? 0 : static_cast<uint8_t>(rng());
+
+    std::vector<uint32_t> background(dst_offset + count + 1);
+    for (auto& pixel : background) pixel = rng();
+
+    std::vector<uint32_t> plain = background;
+    std::vector<uint32_t> keyed = background;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t index = src[src_offset + i];
+        plain[dst_offset + i] = lut[index];
+        if (index != 0) keyed[dst_offset + i] = lut[index];
+    }
+
+    for (Isa isa : supported_isas()) {
+        std::string suffix = "(" + std::string(kernels::isa_name(isa)) + ", count " + std::to_string(count) +
+                             ", offsets " + std::to_string(src_offset) + "/" + std::to_string(dst_offset) + ")";
+
+        std::vector<uint32_t> dst = background;
+        kernels::indexed_to_argb(src.data() + src_offset, count, lut, dst.data() + dst_offset, isa);
+        check_equal(plain, dst, "indexed_to_argb" + suffix);
+
+        dst = background;
+        kernels::indexed_to_argb_keyed(src.data() + src_offset, count, lut, dst.data() + dst_offset, isa);
+        check_equal(keyed, dst, "indexed_to_argb_keyed" + suffix);
+    }
+}
+
+int main() {
+    std::cout << "Best ISA: " << kernels::isa_name(kernels::detect_isa()) << std::endl;
+    std::mt19937 rng(1);
+
+    // Plane lengths around the 16 and 32 byte vector widths, then tiles
+    // (16x16), sprites and a full 320x200 background
+    std::vector<size_t> plane_lengths = {0, 1, 3, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 95, 97, 128, 131, 8000};
+    for (size_t plane_length : plane_lengths) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            test_planar(plane_length * 4, offset, (offset * 3) % 4, rng);
+        }
+    }
+
+    // Counts around the vector widths, then a 320-pixel row and a full screen
+    std::vector<size_t> counts = {0, 1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 65, 127, 129, 321, 64000};
+    for (size_t count : counts) {
+        for (size_t offset = 0; offset < 4; offset++) {
+            test_argb(count, offset, (offset * 3) % 4, false, rng);
+            test_argb(count, offset, (offset + 1) % 4, true, rng);
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All kernels match the scalar path" << std::endl;
+    return 0;
+}
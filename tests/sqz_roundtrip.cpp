@@ -0,0 +1,224 @@
+#include "sqz_unpacker.h"
+#include "sqz_packer.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Packs every input with each encoder and checks that all decoding entry
+// points reproduce it byte for byte.
+//
+// Usage: sqz_roundtrip [archive_dir]
+// Archives found in archive_dir are unpacked and their payloads used as
+// real inputs alongside the generated ones.
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+static void check_equal(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual,
+                        const std::string& what) {
+    if (actual.size() != expected.size()) {
+        check(false, what + ": size " + std::to_string(actual.size()) + ", expected " +
+                     std::to_string(expected.size()));
+        return;
+    }
+    auto diff = std::mismatch(expected.begin(), expected.end(), actual.begin());
+    check(diff.first == expected.end(),
+          what + ": first difference at byte " + std::to_string(diff.first - expected.begin()));
+}
+
+// ============================================================================
+// Decoders
+// ============================================================================
+
+// Feed and pull in uneven pieces so token and window boundaries land
+// everywhere
+static std::vector<uint8_t> decode_stream(const std::vector<uint8_t>& archive, bool alt_lzw, uint32_t seed) {
+    std::mt19937 rng(seed);
+    sqz::StreamDecoder decoder(alt_lzw);
+    std::vector<uint8_t> output;
+    std::vector<uint8_t> chunk(4096);
+    size_t fed = 0;
+
+    for (;;) {
+        size_t count = decoder.pull(chunk.data(), 1 + rng() % chunk.size());
+        if (count > 0) {
+            output.insert(output.end(), chunk.begin(), chunk.begin() + count);
+            continue;
+        }
+        if (fed == archive.size()) {
+            decoder.finish();
+            while ((count = decoder.pull(chunk.data(), chunk.size())) > 0) {
+                output.insert(output.end(), chunk.begin(), chunk.begin() + count);
+            }
+            break;
+        }
+        size_t n = std::min<size_t>(archive.size() - fed, 1 + rng() % 3000);
+        decoder.feed(archive.data() + fed, n);
+        fed += n;
+    }
+
+    check(decoder.done(), "StreamDecoder did not reach the end of the stream");
+    return output;
+}
+
+static std::vector<uint8_t> decode_chunked(const std::vector<uint8_t>& archive, size_t chunk_size) {
+    std::vector<uint8_t> output;
+    sqz::unpack_chunked(archive.data(), archive.size(), chunk_size, [&](const uint8_t* data, size_t size) {
+        check(size > 0 && size <= chunk_size, "unpack_chunked chunk size out of range");
+        output.insert(output.end(), data, data + size);
+    });
+    return output;
+}
+
+static std::vector<uint8_t> decode_into(const std::vector<uint8_t>& archive) {
+    sqz::ArchiveInfo info = sqz::probe(archive.data(), archive.size());
+    std::vector<uint8_t> output(info.payload_size);
+    size_t written = sqz::unpack_into(archive.data(), archive.size(), output.data(), output.size());
+    output.resize(written);
+    return output;
+}
+
+// ============================================================================
+// Round Trips
+// ============================================================================
+
+struct Encoding {
+    const char* name;
+    sqz::Format format;
+    bool alt_lzw;
+};
+
+static const Encoding ENCODINGS[] = {
+    {"lzw", sqz::Format::Lzw, false},
+    {"lzw-alt", sqz::Format::Lzw, true},
+    {"huffman", sqz::Format::HuffmanRle, false},
+    {"diet", sqz::Format::Diet, false},
+};
+
+static void round_trip(const std::string& name, const std::vector<uint8_t>& payload) {
+    for (const auto& encoding : ENCODINGS) {
+        std::string what = name + " (" + encoding.name + ")";
+        try {
+            std::vector<uint8_t> archive = encoding.alt_lzw
+                ? sqz::pack_lzw(payload.data(), payload.size(), true)
+                : sqz::pack(encoding.format, payload.data(), payload.size());
+
+            sqz::ArchiveInfo info = sqz::probe(archive.data(), archive.size());
+            check(info.format == encoding.format, what + ": probe reports the wrong format");
+            check(info.payload_size == payload.size(), what + ": probe reports the wrong size");
+
+            if (encoding.alt_lzw) {
+                // The header does not record the code order, so only the
+                // decoders that take it can read these archives
+                check_equal(payload, sqz::unpack_alt_lzw(archive.data(), archive.size()), what + " unpack_alt_lzw");
+            } else {
+                check_equal(payload, sqz::unpack(archive.data(), archive.size()), what + " unpack");
+                check_equal(payload, decode_into(archive), what + " unpack_into");
+                check_equal(payload, decode_chunked(archive, 1), what + " unpack_chunked(1)");
+                check_equal(payload, decode_chunked(archive, 4000), what + " unpack_chunked(4000)");
+            }
+            check_equal(payload, decode_stream(archive, encoding.alt_lzw, 7), what + " StreamDecoder");
+        } catch (const std::exception& e) {
+            check(false, what + ": " + e.what());
+        }
+    }
+}
+
+// ============================================================================
+// Inputs
+// ============================================================================
+
+static std::vector<uint8_t> random_bytes(size_t size, uint32_t seed, unsigned alphabet) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) byte = static_cast<uint8_t>(rng() % alphabet);
+    return data;
+}
+
+// Runs and back-references of varying length, closer to game data than noise
+static std::vector<uint8_t> structured_bytes(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data;
+    while (data.size() < size) {
+        size_t block = std::min<size_t>(size - data.size(), 1 + rng() % 600);
+        switch (rng() % 3) {
+            case 0:
+                data.insert(data.end(), block, static_cast<uint8_t>(rng()));
+                break;
+            case 1:
+                for (size_t i = 0; i < block; i++) data.push_back(static_cast<uint8_t>(rng() % 16));
+                break;
+            default: {
+                size_t distance = 1 + rng() % std::max<size_t>(data.size(), 1);
+                for (size_t i = 0; i < block; i++) {
+                    data.push_back(data.size() >= distance ? data[data.size() - distance] : 0);
+                }
+                break;
+            }
+        }
+    }
+    return data;
+}
+
+int main(int argc, char* argv[]) {
+    round_trip("empty", {});
+    round_trip("1 byte", {0x42});
+    round_trip("2 bytes", {0x00, 0xFF});
+    for (uint32_t seed = 1; seed <= 4; seed++) {
+        round_trip("noise " + std::to_string(seed), random_bytes(1000 * seed * seed, seed, 256));
+        round_trip("4 symbols " + std::to_string(seed), random_bytes(30000 * seed, seed, 4));
+        round_trip("structured " + std::to_string(seed), structured_bytes(60000 * seed, seed));
+    }
+    round_trip("flat 0xFFFFF", std::vector<uint8_t>(0xFFFFF, 0x11));
+    round_trip("noise 0xFFFFF", random_bytes(0xFFFFF, 99, 256));
+
+    // This file stands in for real text when no archives are available
+    std::ifstream self(__FILE__, std::ios::binary);
+    if (self) {
+        round_trip("source", std::vector<uint8_t>(std::istreambuf_iterator<char>(self), std::istreambuf_iterator<char>()));
+    }
+
+    std::string dir = argc > 1 ? argv[1] : "sqz";
+    if (std::filesystem::is_directory(dir)) {
+        std::vector<std::filesystem::path> archives;
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file() && sqz::is_archive_name(entry.path().string())) {
+                archives.push_back(entry.path());
+            }
+        }
+        std::sort(archives.begin(), archives.end());
+        for (const auto& path : archives) {
+            std::vector<uint8_t> payload;
+            try {
+                payload = sqz::unpack(path.string());
+            } catch (const std::exception& e) {
+                std::cout << "skipping " << path.filename().string() << ": " << e.what() << std::endl;
+                continue;
+            }
+            round_trip(path.filename().string(), payload);
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All round trips passed" << std::endl;
+    return 0;
+}